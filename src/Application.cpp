@@ -21,12 +21,18 @@
 #include <boost/program_options.hpp>
 namespace bpo = boost::program_options;
 
+#include <string.h>
+#include <sys/time.h>
 #include "Application.h"
 #include "Curl.h"
+#include "Replay.h"
+#include "Utils.h"
 
 using namespace std;
 
 Application::Application()
+  : m_loader(NULL),
+    m_headless(false)
 {
   m_nmtSettings = new NMTSettings();
   m_renderer = new Renderer();
@@ -39,6 +45,11 @@ Application::Application()
 
 Application::~Application()
 {
+  // Screens cancel their timers on destruction, so they go first.
+  while (m_stack.pop());
+  m_stack.cleanUp();
+
+  delete m_loader;
   delete m_nmtSettings;
   delete m_indexer;
   delete m_db;
@@ -55,7 +66,9 @@ Application::~Application()
 void Application::startGUI(int argc, char **argv)
 {
   Renderer *r = m_renderer;
-  r->initialize(argc, argv, m_nmtSettings);
+  r->initialize(argc, argv, m_nmtSettings, m_headless);
+  m_loader = new QueryLoader(r->backend());
+  m_loader->start();
   r->color(0, 0, 0, 0xff);
   r->rect(0, 0, r->width(), r->height());
   r->color(0xff, 0xff, 0xff, 0xff);
@@ -105,9 +118,7 @@ void Application::startGUI(int argc, char **argv)
 
   r->color(0x0, 0x0, 0x0, 0xff);
   r->rect(0, 0, r->width(), r->height());
-  r->flip();  
-  r->rect(0, 0, r->width(), r->height());
-  r->flip();    
+  r->flip(true);  
 }
 
 void Application::setScreen(Screen *screen) 
@@ -118,18 +129,17 @@ void Application::setScreen(Screen *screen)
   }
   m_stack.push(screen);
   if (m_renderer->initialized()) {
-    screen->setDirty();
-    screen->paint();
-    m_renderer->flip();
-    screen->paint();
-    m_renderer->flip();
+    show(screen);
   }
 }
 
 void Application::run()
 {
   if (m_renderer->initialized()) {
-    m_renderer->loop(this);
+    m_profiler.installSignalHandler();
+    if (m_replay_script.empty()) m_renderer->loop(this);
+    else replay();
+    m_profiler.summarize();
   }
 }
 
@@ -142,33 +152,99 @@ void Application::exit()
 
 void Application::go(Screen *screen) 
 { 
+  Screen *covered = m_stack.top();
+
+  if (covered && m_renderer->initialized()) {
+    // Bring the back buffer up to the frame on screen and keep it for
+    // back().  Changes from here on mark the covered screen dirty as usual.
+    covered->paint();
+    covered->setSnapshot(m_renderer->snapshot());
+    covered->clearDirty(0);
+    covered->clearDirty(1);
+  }
+  if (covered && !covered->snapshot()) covered->setDirty();
   m_stack.push(screen); 
   if (m_renderer->initialized()) {
-    screen->setDirty();
-    screen->paint();
-    m_renderer->flip();
-    screen->paint();
-    m_renderer->flip();
+    show(screen);
   }
 }
 
+// Shows the snapshot of the screen uncovered if it still has one, which
+// leaves only what changed since to be painted.
 void Application::back() 
 { 
   if (m_stack.size() > 1) {
     m_stack.pop(); 
     if (m_renderer->initialized()) {
       Screen *screen = m_stack.top();
-      screen->setDirty();
-      screen->paint();
-      m_renderer->flip();
-      screen->paint();
-      m_renderer->flip();
+#ifdef DEBUG
+      unsigned start = m_renderer->scheduler()->now();
+#endif
+
+      if (m_renderer->present(screen->snapshot()))
+        debug("snapshot of %s in %u ms\n", screen->label(), m_renderer->scheduler()->now() - start);
+      else
+        show(screen);
+      screen->setSnapshot(0);
     }
   }
 }
 
+void Application::show(Screen *screen)
+{
+#ifdef DEBUG
+  unsigned start = m_renderer->scheduler()->now();
+#endif
+
+  screen->setDirty();
+  screen->paint();
+  m_renderer->flip(true);
+  // Both buffers now hold the new screen.
+  screen->clearDirty(0);
+  screen->clearDirty(1);
+  debug("first frame of %s in %u ms\n", screen->label(), m_renderer->scheduler()->now() - start);
+}
+
+void Application::play(const char *file)
+{
+  if (!m_audio->isStopped()) m_audio->close();
+  debug("playing %s\n", file);
+
+#ifdef DEBUG
+  unsigned exited = m_renderer->play(file);
+#else
+  m_renderer->play(file);
+#endif
+  Screen *screen = m_stack.top();
+
+  if (screen) show(screen);
+  debug("first frame %u ms after the player exited\n", m_renderer->scheduler()->now() - exited);
+}
+
+// Paints and flips screen, recording the frame as started at start.
+void Application::present(Screen *screen, unsigned long long start)
+{
+  unsigned long long painted, flipped;
+  unsigned long long begin = Profiler::now();
+  int area;
+
+  screen->paint();
+  painted = Profiler::now();
+  area = m_renderer->damageArea();
+  m_renderer->flip();
+  flipped = Profiler::now();
+
+  m_profiler.record(screen->label(), PROFILE_PAINT, painted - begin);
+  if (!area) return;
+  m_profiler.record(screen->label(), PROFILE_FLIP, flipped - painted);
+  m_profiler.record(screen->label(), PROFILE_FRAME, flipped - start);
+  m_profiler.frame(screen->label(), m_renderer->frameStats().draws, area);
+}
+
 bool Application::handleEvent(Event &event)
 {
+  unsigned long long start = Profiler::now();
+
   m_stack.cleanUp();
   
   switch (event.key) {
@@ -182,9 +258,8 @@ bool Application::handleEvent(Event &event)
 
   if (screen) {
     if (!screen->handleEvent(event)) back();
-    screen = m_stack.top();
-    screen->paint();
-    m_renderer->flip();
+    m_profiler.record(screen->label(), PROFILE_EVENT, Profiler::now() - start);
+    present(m_stack.top(), start);
   }
 
   return true;
@@ -192,21 +267,80 @@ bool Application::handleEvent(Event &event)
 
 bool Application::handleIdle()
 {
+  std::vector<Box> regions;
+  unsigned long long start = Profiler::now();
+
   m_stack.cleanUp();
+  m_profiler.poll();
 
   Screen *screen = m_stack.top();
 
   if (screen) {
-    if (screen->handleIdle()) {
-      screen = m_stack.top();
-      screen->paint();
-      m_renderer->flip();
+    bool loaded = m_renderer->pollImages(regions);
+    for (int i=0; i < regions.size(); i++)
+      screen->setDirtyRegion(regions[i]);
+    if (screen->handleIdle() || loaded) {
+      m_profiler.record(screen->label(), PROFILE_IDLE, Profiler::now() - start);
+      present(m_stack.top(), start);
     }
   }
 
   return true;
 }
 
+// Moves the simulated clock forward by ms, firing timers and running idle
+// processing at each deadline on the way.
+void Application::advance(int ms)
+{
+  Scheduler *scheduler = m_renderer->scheduler();
+  unsigned end = m_replay_clock.now() + ms;
+
+  do {
+    int step = (int)(end - m_replay_clock.now()), timeout = scheduler->timeout();
+    if (timeout >= 0 && timeout < step) step = maximum(timeout, 1);
+    m_replay_clock.advance(step);
+    scheduler->run();
+    handleIdle();
+  } while ((int)(end - m_replay_clock.now()) > 0);
+}
+
+// Feeds the replay script through handleEvent(), with time advanced by the
+// script instead of the wall clock, and prints how long each step took.
+void Application::replay()
+{
+  Replay script;
+  double total = 0;
+  int events = 0;
+
+  if (!script.load(m_replay_script.c_str())) return;
+
+  printf("%-5s %-10s %5s %9s %9s %9s\n", "line", "key", "count", "mean ms", "max ms", "total ms");
+  for (int i=0; i < script.size(); i++) {
+    const ReplayStep &step = script.step(i);
+    double elapsed = 0, longest = 0;
+
+    for (int n=0; n < step.count; n++) {
+      Event event;
+      event.type = EVENT_KEYPRESS;
+      event.key = step.key;
+      event.repeat = n > 0;
+
+      advance(n ? REPLAY_REPEAT_DELAY : step.delay);
+      unsigned long long start = Profiler::now();
+      handleEvent(event);
+      double ms = (Profiler::now() - start) / 1000.0;
+      elapsed += ms;
+      longest = maximum(longest, ms);
+    }
+    printf("%-5d %-10s %5d %9.2f %9.2f %9.2f\n", step.line, step.name.c_str(), step.count, 
+           elapsed / step.count, longest, elapsed);
+    total += elapsed;
+    events += step.count;
+  }
+  advance(REPLAY_SETTLE_TIME);
+  printf("%d events in %.2f ms\n", events, total);
+}
+
 int Application::parseCommandLine(int argc, char **argv)
 {
   int status = 1;
@@ -215,6 +349,9 @@ int Application::parseCommandLine(int argc, char **argv)
   desc.add_options()
     ("help", "produce help message")
     ("videomode", bpo::value<int>(), "Set (override default) video mode")
+    ("headless", "Render into memory instead of DirectFB")
+    ("benchmark-utf8", "Time UTF-8 decoding of the tags and paths in the database")
+    ("replay", bpo::value<std::string>(), "Play a script of key presses on a simulated clock and report the latency of each step")
     ;
 
   bpo::variables_map vm;
@@ -238,9 +375,72 @@ int Application::parseCommandLine(int argc, char **argv)
       << videoMode << ": " << m_nmtSettings->getVideoModeStr() << ".\n";
   }
 
+  if (vm.count("headless"))
+  {
+    m_headless = true;
+  }
+
+  if (vm.count("replay"))
+  {
+    // Before any screen schedules a timer.
+    m_replay_script = vm["replay"].as<std::string>();
+    m_renderer->setClock(&m_replay_clock);
+  }
+
+  if (vm.count("benchmark-utf8"))
+  {
+    benchmarkUTF8();
+    return 0;
+  }
+
   return status;
 }
 
+void Application::benchmarkUTF8()
+{
+  std::vector<std::string> strings;
+  std::vector<long> ucs;
+  const char *queries[] = {
+    "select title as s from songs", "select path as s from songs", "select album as s from albums",
+    "select artist as s from artists", "select genre as s from genres"
+  };
+  int bytes = 0, ascii = 0, chars = 0, passes = 0;
+  struct timeval start, now;
+  double elapsed;
+  Result *r;
+
+  for (int i=0; i < sizeof(queries)/sizeof(queries[0]); i++) {
+    m_db->execute(queries[i]);
+    while ((r = m_db->next())) {
+      const char *s = (*r)[(char *)"s"];
+      if (!s) continue;
+      strings.push_back(s);
+      bytes += strlen(s);
+      for (const char *c = s; *c; c++) ascii += !(*c & 0x80);
+    }
+  }
+  if (strings.empty()) {
+    cout << "No tags in the database to decode.\n";
+    return;
+  }
+
+  gettimeofday(&start, NULL);
+  do {
+    for (int i=0; i < strings.size(); i++) {
+      if (ucs.size() < strings[i].size() + 1) ucs.resize(strings[i].size() + 1);
+      chars += decodeUTF8(strings[i].c_str(), strings[i].size(), &ucs[0], ucs.size());
+    }
+    passes++;
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+  } while (elapsed < 1.0);
+
+  printf("%d strings, %d bytes (%d%% ASCII), %d passes\n", (int)strings.size(), bytes, 
+         (int)(100.0 * ascii / maximum(bytes, 1)), passes);
+  printf("%.1f MB/s, %.0f ns per string, %d chars decoded\n", bytes * (double)passes / elapsed / 1e6,
+         elapsed * 1e9 / ((double)strings.size() * passes), chars);
+}
+
 Stack::Stack()
 {
   m_top = -1;
@@ -270,7 +470,6 @@ bool Stack::push(Screen *screen)
 {
   screen->setDirty();
   if (m_top < MAX_STACK_SIZE-1) {
-    if (m_top > -1) m_screens[m_top]->setDirty();
     m_screens[++m_top] = screen;
     return true;
   }
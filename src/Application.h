@@ -25,10 +25,14 @@
 #include "Renderer.h"
 #include "Audio.h"
 #include "Database.h"
+#include "QueryLoader.h"
 #include "Indexer.h"
 #include "NMTSettings.h"
+#include "Profiler.h"
 
 #define MAX_STACK_SIZE 100
+// Simulated time given to timers after the last step of a replay.
+#define REPLAY_SETTLE_TIME 1000
 
 class Stack
 {
@@ -52,13 +56,22 @@ class Application : public EventListener
   Renderer *m_renderer;
   Audio *m_audio;
   Database *m_db;
+  QueryLoader *m_loader;
   Indexer *m_indexer;
   Stack m_stack;
   NMTSettings * m_nmtSettings;
+  Profiler m_profiler;
+  std::string m_replay_script;
+  ManualClock m_replay_clock;
+  bool m_headless;
 
  protected:
   bool handleEvent(Event &event);
   bool handleIdle();
+  void show(Screen *screen);
+  void present(Screen *screen, unsigned long long start);
+  void advance(int ms);
+  void replay();
 
  public: 
   Application();
@@ -67,12 +80,16 @@ class Application : public EventListener
   void setScreen(Screen *screen);
   void go(Screen *screen);
   void back();
+  void play(const char *file);
   void run();
   void exit();
   int parseCommandLine(int argc, char **argv);
+  void benchmarkUTF8();
   Renderer *renderer() { return m_renderer; }
   Audio *audio() { return m_audio; }
   Database *database() { return m_db; }
+  QueryLoader *loader() { return m_loader; }
+  Screen *top() { return m_stack.top(); }
   Indexer *indexer() { return m_indexer; }
   NMTSettings * nmtSettings() { return m_nmtSettings; };
 };
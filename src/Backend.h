@@ -0,0 +1,52 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "Surface.h"
+#include "Event.h"
+
+// Display, image decoding and input for the Renderer.  open() and close()
+// may be called repeatedly, e.g. around handing the screen to the
+// external video player.
+
+class Backend
+{
+ public:
+  virtual ~Backend() {};
+  virtual bool open() = 0;
+  virtual void close() = 0;
+  virtual Surface *primary() = 0;
+  virtual Surface *createSurface(DFBSurfaceDescription *dsc) = 0;
+  // Decodes path into a malloc'd DSPF_ARGB buffer scaled by scale, which
+  // is returned in dsc->preallocated[0].  The caller owns the buffer.
+  virtual bool decodeImage(const char *path, float scale, DFBSurfaceDescription *dsc) = 0;
+  // False if decodeImage() only fills in placeholder pixels, which must
+  // not end up in the disk cache.
+  virtual bool decodesPixels() { return true; }
+  // Blocks until input arrives, wakeUp() is called or timeout ms have
+  // passed.  A negative timeout waits indefinitely.
+  virtual void waitForEvent(int timeout) = 0;
+  // Interrupts waitForEvent(); may be called from any thread.
+  virtual void wakeUp() = 0;
+  virtual bool getEvent(Event *event) = 0;
+};
+
+#endif
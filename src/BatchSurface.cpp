@@ -0,0 +1,233 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "config.h"
+#include "BatchSurface.h"
+
+BatchSurface::BatchSurface(Surface *target)
+  : m_target(target),
+    m_source(NULL)
+{
+  int width, height;
+  m_target->getSize(&width, &height);
+  DFBRegion clip = { 0, 0, width - 1, height - 1 };
+  m_clip = clip;
+  memset(m_color, 0, sizeof(m_color));
+  m_drawing_flags = DSDRAW_NOFX;
+  m_blitting_flags = DSBLIT_NOFX;
+  memset(&m_frame, 0, sizeof(m_frame));
+  memset(&m_last_frame, 0, sizeof(m_last_frame));
+  invalidate();
+}
+
+void BatchSurface::invalidate()
+{
+  m_target_valid = false;
+}
+
+void BatchSurface::applyClip()
+{
+  if (m_target_valid && !memcmp(&m_clip, &m_target_clip, sizeof(m_clip))) return;
+  m_target->setClip(&m_clip);
+  m_target_clip = m_clip;
+  m_frame.state_changes++;
+}
+
+void BatchSurface::applyColor()
+{
+  if (m_target_valid && !memcmp(m_color, m_target_color, sizeof(m_color))) return;
+  m_target->setColor(m_color[0], m_color[1], m_color[2], m_color[3]);
+  memcpy(m_target_color, m_color, sizeof(m_color));
+  m_frame.state_changes++;
+}
+
+void BatchSurface::applyDrawingFlags()
+{
+  if (m_target_valid && m_drawing_flags == m_target_drawing_flags) return;
+  m_target->setDrawingFlags(m_drawing_flags);
+  m_target_drawing_flags = m_drawing_flags;
+  m_frame.state_changes++;
+}
+
+void BatchSurface::applyBlittingFlags()
+{
+  if (m_target_valid && m_blitting_flags == m_target_blitting_flags) return;
+  m_target->setBlittingFlags(m_blitting_flags);
+  m_target_blitting_flags = m_blitting_flags;
+  m_frame.state_changes++;
+}
+
+void BatchSurface::flush()
+{
+  if (!m_source) return;
+
+  // Everything must be applied before the state is known to be valid.
+  bool valid = m_target_valid;
+  applyClip();
+  applyBlittingFlags();
+  if (m_blitting_flags & DSBLIT_COLORIZE || !valid) applyColor();
+  if (!valid) applyDrawingFlags();
+  m_target_valid = true;
+
+  if (m_rects.size() == 1)
+    m_target->blit(m_source, &m_rects[0], m_points[0].x, m_points[0].y);
+  else
+    m_target->batchBlit(m_source, &m_rects[0], &m_points[0], m_rects.size());
+  m_frame.batches++;
+  m_source = NULL;
+  m_rects.clear();
+  m_points.clear();
+}
+
+void BatchSurface::getSize(int *width, int *height)
+{
+  m_target->getSize(width, height);
+}
+
+DFBSurfacePixelFormat BatchSurface::pixelFormat()
+{
+  return m_target->pixelFormat();
+}
+
+void BatchSurface::setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+  unsigned char color[4] = { r, g, b, a };
+  if (!memcmp(color, m_color, sizeof(color))) {
+    m_frame.state_skipped++;
+    return;
+  }
+  if (m_blitting_flags & DSBLIT_COLORIZE) flush();
+  memcpy(m_color, color, sizeof(color));
+}
+
+void BatchSurface::setClip(const DFBRegion *clip)
+{
+  DFBRegion region = m_clip;
+  if (clip) region = *clip;
+  else {
+    int width, height;
+    m_target->getSize(&width, &height);
+    DFBRegion full = { 0, 0, width - 1, height - 1 };
+    region = full;
+  }
+  if (!memcmp(&region, &m_clip, sizeof(region))) {
+    m_frame.state_skipped++;
+    return;
+  }
+  flush();
+  m_clip = region;
+}
+
+void BatchSurface::getClip(DFBRegion *clip)
+{
+  *clip = m_clip;
+}
+
+void BatchSurface::setDrawingFlags(DFBSurfaceDrawingFlags flags)
+{
+  if (flags == m_drawing_flags) {
+    m_frame.state_skipped++;
+    return;
+  }
+  m_drawing_flags = flags;
+}
+
+void BatchSurface::setBlittingFlags(DFBSurfaceBlittingFlags flags)
+{
+  if (flags == m_blitting_flags) {
+    m_frame.state_skipped++;
+    return;
+  }
+  flush();
+  m_blitting_flags = flags;
+}
+
+void BatchSurface::fillRectangle(int x, int y, int w, int h)
+{
+  flush();
+  bool valid = m_target_valid;
+  applyClip();
+  applyColor();
+  applyDrawingFlags();
+  if (!valid) applyBlittingFlags();
+  m_target_valid = true;
+  m_target->fillRectangle(x, y, w, h);
+  m_frame.draws++;
+}
+
+void BatchSurface::drawLine(int x1, int y1, int x2, int y2)
+{
+  flush();
+  bool valid = m_target_valid;
+  applyClip();
+  applyColor();
+  applyDrawingFlags();
+  if (!valid) applyBlittingFlags();
+  m_target_valid = true;
+  m_target->drawLine(x1, y1, x2, y2);
+  m_frame.draws++;
+}
+
+void BatchSurface::blit(Surface *source, const DFBRectangle *rect, int x, int y)
+{
+  DFBRectangle r = { 0, 0, 0, 0 };
+  DFBPoint p = { x, y };
+
+  if (rect) r = *rect;
+  else source->getSize(&r.w, &r.h);
+
+  if (source != m_source) flush();
+  m_source = source;
+  m_rects.push_back(r);
+  m_points.push_back(p);
+  m_frame.draws++;
+  m_frame.blits++;
+}
+
+void BatchSurface::batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num)
+{
+  for (int i=0; i < num; i++)
+    blit(source, &rects[i], points[i].x, points[i].y);
+}
+
+void BatchSurface::flip(const DFBRegion *region, DFBSurfaceFlipFlags flags)
+{
+  flush();
+  m_target->flip(region, flags);
+}
+
+void BatchSurface::endFrame()
+{
+  debug("frame: %d draws, %d blits in %d batches, %d state changes, %d skipped\n",
+        m_frame.draws, m_frame.blits, m_frame.batches, m_frame.state_changes, m_frame.state_skipped);
+  m_last_frame = m_frame;
+  memset(&m_frame, 0, sizeof(m_frame));
+}
+
+bool BatchSurface::lock(void **data, int *pitch)
+{
+  flush();
+  return m_target->lock(data, pitch);
+}
+
+void BatchSurface::unlock()
+{
+  m_target->unlock();
+}
@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCHSURFACE_H
+#define BATCHSURFACE_H
+
+#include <vector>
+#include "Surface.h"
+
+struct FrameStats
+{
+  int draws;
+  int blits;
+  int batches;
+  int state_changes;
+  int state_skipped;
+};
+
+// Wraps the primary surface.  State set through it is only forwarded
+// when a draw actually needs it and it differs from what the target
+// already has, and consecutive blits from the same source with the same
+// state are submitted as one BatchBlit.
+
+class BatchSurface : public Surface
+{
+ private:
+  Surface *m_target;
+  unsigned char m_color[4];
+  DFBRegion m_clip;
+  DFBSurfaceDrawingFlags m_drawing_flags;
+  DFBSurfaceBlittingFlags m_blitting_flags;
+  unsigned char m_target_color[4];
+  DFBRegion m_target_clip;
+  DFBSurfaceDrawingFlags m_target_drawing_flags;
+  DFBSurfaceBlittingFlags m_target_blitting_flags;
+  bool m_target_valid;
+  Surface *m_source;
+  std::vector<DFBRectangle> m_rects;
+  std::vector<DFBPoint> m_points;
+  FrameStats m_frame;
+  FrameStats m_last_frame;
+
+ private:
+  void applyClip();
+  void applyColor();
+  void applyDrawingFlags();
+  void applyBlittingFlags();
+
+ public:
+  BatchSurface(Surface *target);
+  void flush();
+  void invalidate();
+  void endFrame();
+  const FrameStats &frameStats() { return m_last_frame; }
+  virtual void getSize(int *width, int *height);
+  virtual DFBSurfacePixelFormat pixelFormat();
+  virtual void setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+  virtual void setClip(const DFBRegion *clip);
+  virtual void getClip(DFBRegion *clip);
+  virtual void setDrawingFlags(DFBSurfaceDrawingFlags flags);
+  virtual void setBlittingFlags(DFBSurfaceBlittingFlags flags);
+  virtual void fillRectangle(int x, int y, int w, int h);
+  virtual void drawLine(int x1, int y1, int x2, int y2);
+  virtual void blit(Surface *source, const DFBRectangle *rect, int x, int y);
+  virtual void batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num);
+  virtual void flip(const DFBRegion *region, DFBSurfaceFlipFlags flags);
+  virtual bool lock(void **data, int *pitch);
+  virtual void unlock();
+};
+
+#endif
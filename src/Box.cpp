@@ -72,3 +72,69 @@ void Box::clip(const Box &box)
   w = maximum(minimum(x+w, box.x+box.w) - x, 0);
   h = maximum(minimum(y+h, box.y+box.h) - y, 0);
 }
+
+static int area(const Box &box)
+{
+  return box.w * box.h;
+}
+
+// merging is worth it when the union is at most 25% larger than the parts
+static bool mergeable(const Box &first, const Box &second)
+{
+  return area(first + second) * 4 <= (area(first) + area(second)) * 5;
+}
+
+void Region::add(const Box &box)
+{
+  if (box.w <= 0 || box.h <= 0) return;
+
+  Box b = box;
+  for (int i=0; i < m_boxes.size(); ) {
+    if (mergeable(m_boxes[i], b)) {
+      b = m_boxes[i] + b;
+      m_boxes.erase(m_boxes.begin() + i);
+      i = 0;
+    }
+    else i++;
+  }
+  m_boxes.push_back(b);
+
+  while (m_boxes.size() > REGION_MAX_BOXES) {
+    int best_i = 0, best_j = 1, best_waste = -1;
+    for (int i=0; i < m_boxes.size(); i++) {
+      for (int j=i+1; j < m_boxes.size(); j++) {
+        int waste = ::area(m_boxes[i] + m_boxes[j]) - ::area(m_boxes[i]) - ::area(m_boxes[j]);
+        if (best_waste < 0 || waste < best_waste) {
+          best_waste = waste;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    m_boxes[best_i] = m_boxes[best_i] + m_boxes[best_j];
+    m_boxes.erase(m_boxes.begin() + best_j);
+  }
+}
+
+Box Region::bounds() const
+{
+  Box b(0,0,0,0);
+  for (int i=0; i < m_boxes.size(); i++)
+    b = b + m_boxes[i];
+  return b;
+}
+
+int Region::area() const
+{
+  int a = 0;
+  for (int i=0; i < m_boxes.size(); i++)
+    a += ::area(m_boxes[i]);
+  return a;
+}
+
+bool operator& (const Region &region, const Box &box)
+{
+  for (int i=0; i < region.size(); i++)
+    if (region.box(i) & box) return true;
+  return false;
+}
@@ -20,6 +20,10 @@
 #ifndef BOX_H
 #define BOX_H
 
+#include <vector>
+
+#define REGION_MAX_BOXES 8
+
 class Box 
 {
  public:
@@ -38,5 +42,26 @@ class Box
 
 Box operator+ (const Box &first, const Box &second);
 bool operator& (const Box &first, const Box &second);
+
+// A handful of boxes.  Boxes that overlap, or are close enough that their
+// union wastes little area, are merged; beyond REGION_MAX_BOXES the pair
+// whose union wastes least is merged.
+
+class Region
+{
+ private:
+  std::vector<Box> m_boxes;
+
+ public:
+  void add(const Box &box);
+  void clear() { m_boxes.clear(); }
+  bool empty() const { return m_boxes.empty(); }
+  int size() const { return m_boxes.size(); }
+  const Box &box(int i) const { return m_boxes[i]; }
+  Box bounds() const;
+  int area() const;
+};
+
+bool operator& (const Region &region, const Box &box);
  
 #endif
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include "Database.h"
 #include "Utils.h"
 #include "File.h"
@@ -26,7 +27,8 @@
 Database::Database(const char *file)
   : m_db(NULL),
     m_result_table(NULL),
-    m_curr_row(0)
+    m_curr_row(0),
+    m_fts(false)
 {
   bool newDB = true;
   FILE *f;
@@ -42,6 +44,8 @@ Database::Database(const char *file)
   }
   
   if (newDB) createTables();
+  createIndexes();
+  createSearch();
 }
 
 void Database::createTables() 
@@ -52,6 +56,34 @@ void Database::createTables()
   execute("CREATE TABLE songs (title text, album_id integer, genre_id integer, length integer, path text)");
 }
 
+// Lets menus read pages in sort order instead of sorting every row.
+void Database::createIndexes()
+{
+  execute("CREATE INDEX IF NOT EXISTS songs_title ON songs (title COLLATE NOCASE)");
+  execute("CREATE INDEX IF NOT EXISTS songs_album_id ON songs (album_id)");
+  execute("CREATE INDEX IF NOT EXISTS albums_album ON albums (album COLLATE NOCASE)");
+  execute("CREATE INDEX IF NOT EXISTS artists_artist ON artists (artist COLLATE NOCASE)");
+  execute("CREATE INDEX IF NOT EXISTS genres_genre ON genres (genre COLLATE NOCASE)");
+}
+
+// Full text index of songs for search(), kept up to date by
+// insertSong().  Built from the songs table the first time; without
+// FTS3 in this SQLite, search() falls back to scanning with LIKE.
+void Database::createSearch()
+{
+  if (!m_db) return;
+  if (execute("select rowid from sqlite_master where type='table' and name='search'")) {
+    m_fts = true;
+    return;
+  }
+  if (sqlite3_exec(m_db, "CREATE VIRTUAL TABLE search USING fts3 (title, artist, album, path)", NULL, NULL, NULL) != SQLITE_OK) {
+    debug("full text search not available: %s\n", sqlite3_errmsg(m_db));
+    return;
+  }
+  m_fts = true;
+  execute("insert into search (rowid, title, artist, album, path) select songs.rowid, title, artist, album, path from songs, albums, artists where albums.rowid=album_id and artists.rowid=artist_id");
+}
+
 int Database::execute(const char *sql_fmt, ...)
 {
   if (!m_db) return false;
@@ -174,7 +206,53 @@ int Database::insertSong(const char *path, const char *title, const char *album,
   debug("inserted genre_id=%d\n", genre_id);
   debug("inserting into songs\n");
   execute("insert into songs (title, album_id, genre_id, length, path) values (%Q, %d, %d, %d, %Q)", title, album_id, genre_id, length, path);
-  return sqlite3_last_insert_rowid(m_db);
+  int song_id = sqlite3_last_insert_rowid(m_db);
+  if (m_fts)
+    execute("insert into search (rowid, title, artist, album, path) values (%d, %Q, %Q, %Q, %Q)", song_id, title, artist, album, path);
+  return song_id;
+}
+
+// Called every few hundred virtual machine instructions while a query
+// runs; a non-zero return interrupts it.
+void Database::progress(int (*handler)(void *), void *arg)
+{
+  if (m_db) sqlite3_progress_handler(m_db, 1000, handler, arg);
+}
+
+// Songs with words starting with each word of terms in their title,
+// artist, album or path.  Returns false if the query was interrupted.
+bool Database::search(const char *terms, int limit, std::vector<SearchResult> &results)
+{
+  std::string match, word;
+
+  results.clear();
+  for (const char *p = terms; ; p++) {
+    // anything but letters and digits separates words
+    if (*p && (isalnum((unsigned char)*p) || (unsigned char)*p >= 0x80)) {
+      word += *p;
+      continue;
+    }
+    if (!word.empty()) {
+      if (!match.empty()) match += " ";
+      match += word + "*";
+      word.clear();
+    }
+    if (!*p) break;
+  }
+  if (match.empty()) return true;
+
+  Query query(this, m_fts ? 
+              "select songs.rowid, songs.title from search, songs where search match ?1 and songs.rowid=search.rowid order by songs.title collate nocase limit ?2" :
+              "select songs.rowid, title from songs, albums, artists where albums.rowid=album_id and artists.rowid=artist_id and (title like ?1 or artist like ?1 or album like ?1) order by title collate nocase limit ?2");
+  query.bind(1, m_fts ? match.c_str() : (std::string("%") + terms + "%").c_str());
+  query.bind(2, limit);
+  while (query.step()) {
+    SearchResult result;
+    result.song_id = query.integer(0);
+    result.title = query.text(1) ? query.text(1) : "";
+    results.push_back(result);
+  }
+  return !query.interrupted();
 }
 
 Database::~Database()
@@ -182,3 +260,80 @@ Database::~Database()
   finalize();
   sqlite3_close(m_db);
 }
+
+Query::Query(Database *db, const char *sql)
+  : m_stmt(NULL),
+    m_status(SQLITE_OK)
+{
+  if (!db->m_db) return;
+  if (sqlite3_prepare_v2(db->m_db, sql, -1, &m_stmt, NULL) != SQLITE_OK) {
+    debug("error preparing SQL query (%s): %s\n", sql, sqlite3_errmsg(db->m_db));
+    sqlite3_finalize(m_stmt);
+    m_stmt = NULL;
+  }
+}
+
+Query::~Query()
+{
+  if (m_stmt) sqlite3_finalize(m_stmt);
+}
+
+void Query::reset()
+{
+  if (!m_stmt) return;
+  sqlite3_reset(m_stmt);
+  m_status = SQLITE_OK;
+  sqlite3_clear_bindings(m_stmt);
+}
+
+void Query::bind(int param, int value)
+{
+  if (m_stmt) sqlite3_bind_int(m_stmt, param, value);
+}
+
+void Query::bind(int param, const char *value)
+{
+  if (m_stmt) sqlite3_bind_text(m_stmt, param, value, -1, SQLITE_TRANSIENT);
+}
+
+bool Query::step()
+{
+  if (!m_stmt) return false;
+  m_status = sqlite3_step(m_stmt);
+  return m_status == SQLITE_ROW;
+}
+
+int Query::columns()
+{
+  return m_stmt ? sqlite3_column_count(m_stmt) : 0;
+}
+
+const char *Query::name(int column)
+{
+  return sqlite3_column_name(m_stmt, column);
+}
+
+int Query::type(int column)
+{
+  return sqlite3_column_type(m_stmt, column);
+}
+
+int Query::integer(int column)
+{
+  return sqlite3_column_int(m_stmt, column);
+}
+
+const char *Query::text(int column)
+{
+  return (const char *)sqlite3_column_text(m_stmt, column);
+}
+
+// The current row by column name, valid until the next step().
+Result *Query::result()
+{
+  m_result.clear();
+  for (int col = 0; col < sqlite3_column_count(m_stmt); col++) {
+    m_result[(char *)sqlite3_column_name(m_stmt, col)] = (char *)sqlite3_column_text(m_stmt, col);
+  }
+  return &m_result;
+}
@@ -21,6 +21,8 @@
 #define DATABASE_H
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include <sqlite3.h>
 #include "config.h"
@@ -31,8 +33,16 @@
 
 typedef std::map<char *, char *, cmp_strcase> Result;
 
+struct SearchResult
+{
+  int song_id;
+  std::string title;
+};
+
 class Database
 {
+  friend class Query;
+
  private:
   sqlite3 *m_db;
   Result m_result;
@@ -41,9 +51,12 @@ class Database
   int m_cols;
   char *m_error;
   int m_curr_row;
+  bool m_fts;
 
  private:
   void createTables();
+  void createIndexes();
+  void createSearch();
   void finalize();
   int insertArtist(const char *artist);
   int insertGenre(const char *genre);
@@ -54,7 +67,35 @@ class Database
   ~Database();
   int execute(const char *sql, ...);
   Result *next();
+  void progress(int (*handler)(void *), void *arg);
+  bool search(const char *terms, int limit, std::vector<SearchResult> &results);
   int insertSong(const char *path, const char *title, const char *album, const char *artist, const char *genre, int length);
 };
 
+// A prepared statement stepped through one row at a time, instead of
+// having its whole result copied out like execute() does.
+class Query
+{
+ private:
+  sqlite3_stmt *m_stmt;
+  Result m_result;
+  int m_status;
+
+ public:
+  Query(Database *db, const char *sql);
+  ~Query();
+  bool valid() { return m_stmt != NULL; }
+  void reset();
+  void bind(int param, int value);
+  void bind(int param, const char *value);
+  bool step();
+  bool interrupted() { return m_status == SQLITE_INTERRUPT; }
+  int columns();
+  const char *name(int column);
+  int type(int column);
+  int integer(int column);
+  const char *text(int column);
+  Result *result();
+};
+
 #endif
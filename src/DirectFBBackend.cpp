@@ -0,0 +1,652 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "DirectFBBackend.h"
+#include "Utils.h"
+
+DirectFBSurface::DirectFBSurface(IDirectFBSurface *surface)
+  : m_surface(surface)
+{
+}
+
+DirectFBSurface::~DirectFBSurface()
+{
+  if (m_surface) m_surface->Release(m_surface);
+}
+
+void DirectFBSurface::getSize(int *width, int *height)
+{
+  m_surface->GetSize(m_surface, width, height);
+}
+
+DFBSurfacePixelFormat DirectFBSurface::pixelFormat()
+{
+  DFBSurfacePixelFormat format = DSPF_UNKNOWN;
+  m_surface->GetPixelFormat(m_surface, &format);
+  return format;
+}
+
+void DirectFBSurface::setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+  m_surface->SetColor(m_surface, r, g, b, a);
+}
+
+void DirectFBSurface::setClip(const DFBRegion *clip)
+{
+  m_surface->SetClip(m_surface, clip);
+}
+
+void DirectFBSurface::getClip(DFBRegion *clip)
+{
+  m_surface->GetClip(m_surface, clip);
+}
+
+void DirectFBSurface::setDrawingFlags(DFBSurfaceDrawingFlags flags)
+{
+  m_surface->SetDrawingFlags(m_surface, flags);
+}
+
+void DirectFBSurface::setBlittingFlags(DFBSurfaceBlittingFlags flags)
+{
+  m_surface->SetBlittingFlags(m_surface, flags);
+}
+
+void DirectFBSurface::fillRectangle(int x, int y, int w, int h)
+{
+  m_surface->FillRectangle(m_surface, x, y, w, h);
+}
+
+void DirectFBSurface::drawLine(int x1, int y1, int x2, int y2)
+{
+  m_surface->DrawLine(m_surface, x1, y1, x2, y2);
+}
+
+void DirectFBSurface::blit(Surface *source, const DFBRectangle *rect, int x, int y)
+{
+  m_surface->Blit(m_surface, ((DirectFBSurface *)source)->m_surface, rect, x, y);
+}
+
+void DirectFBSurface::batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num)
+{
+  m_surface->BatchBlit(m_surface, ((DirectFBSurface *)source)->m_surface, rects, points, num);
+}
+
+void DirectFBSurface::flip(const DFBRegion *region, DFBSurfaceFlipFlags flags)
+{
+  m_surface->Flip(m_surface, region, flags);
+}
+
+bool DirectFBSurface::lock(void **data, int *pitch)
+{
+  return m_surface->Lock(m_surface, (DFBSurfaceLockFlags)(DSLF_READ | DSLF_WRITE), data, pitch) == DFB_OK;
+}
+
+void DirectFBSurface::unlock()
+{
+  m_surface->Unlock(m_surface);
+}
+
+DirectFBBackend::DirectFBBackend(int argc, char **argv, int videoMode)
+  : m_valid(false),
+    m_videoMode(videoMode),
+    m_dfb(NULL),
+    m_primary(NULL),
+    m_eventBuffer(NULL),
+    m_input(NULL)
+{
+  if (DirectFBInit(&argc, &argv) != DFB_OK) {
+    fprintf(stderr, "Error in DirectFBInit!\n");
+    return;
+  }
+  m_valid = true;
+}
+
+DirectFBBackend::~DirectFBBackend()
+{
+  close();
+}
+
+bool DirectFBBackend::open()
+{
+  if (!m_valid) return false;
+
+  // Set Video mode, if requested.
+  // Must be done before DirectFBCreate()!
+  if (m_videoMode != -1)
+  {
+    setVideoMode(m_videoMode);
+  }
+
+  DFBSurfaceDescription dsc;
+  IDirectFBSurface *surface;
+
+  if (DirectFBCreate(&m_dfb) != DFB_OK) {
+    fprintf(stderr, "Error in DirectFBCreate!\n"); return false;
+  }
+
+  if (m_dfb->SetCooperativeLevel(m_dfb, DFSCL_EXCLUSIVE) != DFB_OK) {
+    fprintf(stderr, "Error in SetCooperativeLevel!\n"); return false;
+  }
+  
+  dsc.flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_PIXELFORMAT);
+  dsc.caps  = (DFBSurfaceCapabilities)(DSCAPS_PRIMARY | DSCAPS_DOUBLE);
+  dsc.pixelformat = (DFBSurfacePixelFormat)DSPF_ARGB;
+  
+  if (m_dfb->CreateSurface( m_dfb, &dsc, &surface ) != DFB_OK) {
+    fprintf(stderr, "Error in CreateSurface!\n"); return false;
+  }
+  m_primary = new DirectFBSurface(surface);
+
+  if (m_dfb->GetInputDevice (m_dfb, INPUT_DEVICE, &m_input) != DFB_OK) {
+    fprintf(stderr, "Error in GetInputDevice!\n"); return false;    
+  }
+  
+  if (m_input->CreateEventBuffer (m_input, &m_eventBuffer) != DFB_OK) {
+    fprintf(stderr, "Error in CreateEventBuffer!\n"); return false;    
+  }
+
+  return true;
+}
+
+void DirectFBBackend::close()
+{
+  if (m_eventBuffer) m_eventBuffer->Release(m_eventBuffer);
+  if (m_input) m_input->Release(m_input);
+  if (m_primary) delete m_primary;
+  if (m_dfb) m_dfb->Release(m_dfb);
+  m_eventBuffer = NULL;
+  m_input = NULL;
+  m_primary = NULL;
+  m_dfb = NULL;
+}
+
+Surface *DirectFBBackend::createSurface(DFBSurfaceDescription *dsc)
+{
+  IDirectFBSurface *surface = NULL;
+  if (!m_dfb || m_dfb->CreateSurface(m_dfb, dsc, &surface) != DFB_OK) {
+    fprintf(stderr, "Error creating surface!\n");
+    return NULL;
+  }
+  return new DirectFBSurface(surface);
+}
+
+bool DirectFBBackend::decodeImage(const char *path, float scale, DFBSurfaceDescription *dsc)
+{
+  IDirectFBImageProvider *provider = NULL;
+  IDirectFBSurface *surface = NULL;
+  bool ok = false;
+
+  dsc->preallocated[0].data = NULL;
+  if (!m_dfb || m_dfb->CreateImageProvider(m_dfb, path, &provider) != DFB_OK) {
+    debug("CreateImageProvider failed\n");
+    return false;
+  }
+
+  if (provider->GetSurfaceDescription(provider, dsc) == DFB_OK) {
+    // Render straight into the system memory copy, so decoding never
+    // touches video memory.
+    dsc->width = (int)(dsc->width * scale);
+    dsc->height = (int)(dsc->height * scale);
+    dsc->pixelformat = DSPF_ARGB;
+    dsc->flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED);
+    dsc->caps = DSCAPS_SYSTEMONLY;
+    dsc->preallocated[0].pitch = dsc->width * 4;
+    dsc->preallocated[1].data = NULL;
+    dsc->preallocated[1].pitch = 0;
+    if (dsc->width > 0 && dsc->height > 0 &&
+        (dsc->preallocated[0].data = calloc(dsc->height, dsc->preallocated[0].pitch))) {
+      if (m_dfb->CreateSurface(m_dfb, dsc, &surface) == DFB_OK) {
+        ok = provider->RenderTo(provider, surface, NULL) == DFB_OK;
+        surface->Release(surface);
+      }
+      else {
+        debug("CreateSurface failed\n");
+      }
+      if (!ok) {
+        free(dsc->preallocated[0].data);
+        dsc->preallocated[0].data = NULL;
+      }
+    }
+  }
+  else {
+    debug("GetSurfaceDescription failed\n");
+  }
+  provider->Release(provider);
+  return ok;
+}
+
+void DirectFBBackend::waitForEvent(int timeout)
+{
+  if (!m_eventBuffer) return;
+  if (timeout < 0)
+    m_eventBuffer->WaitForEvent(m_eventBuffer);
+  else
+    m_eventBuffer->WaitForEventWithTimeout(m_eventBuffer, timeout / 1000, timeout % 1000);
+}
+
+void DirectFBBackend::wakeUp()
+{
+  if (m_eventBuffer) m_eventBuffer->WakeUp(m_eventBuffer);
+}
+
+bool DirectFBBackend::getEvent(Event *event)
+{
+  DFBInputEvent dfb_event;
+
+  while (m_eventBuffer && m_eventBuffer->GetEvent(m_eventBuffer, DFB_EVENT(&dfb_event)) == DFB_OK) {
+    if (dfb_event.type == DIET_KEYPRESS) {
+      event->type = EVENT_KEYPRESS;
+      event->key = (Key)dfb_event.key_symbol;
+      event->repeat = dfb_event.flags & DIEF_REPEAT;
+#ifdef NMT
+      if (event->key == (Key)DIKS_PAUSE) event->key = (Key)DIKS_PLAY;
+#endif
+      debug("got key: 0x%x 0x%x\n", (int)(event->key & 0xFF00), (int)(event->key & 0xFF));
+      return true;
+    }
+  }
+  return false;
+}
+
+void DirectFBBackend::setVideoMode(int videoMode)
+{
+  int full_width;
+  int full_height;
+  char dfb_mode[32];
+	char * dtv_signal = NULL;
+	char * dtv_tv_standard = NULL;
+	char * dtv_connector = NULL;
+	char * component_signal = NULL;
+	char * component_tv_standard = NULL;
+	char * component_connector = NULL;
+	char * analog_signal = NULL;
+	char * analog_tv_standard = NULL;
+	char * analog_connector = NULL;
+
+  debug("Set video mode: %d\n", videoMode);
+
+  switch (videoMode)
+  {
+#if 0
+    case (0):
+    {
+      debug("Mode: Auto\n");
+
+      //! \todo How should this be implemented?
+    }
+    break;
+#endif
+
+    case (1):
+    {
+      debug("Mode: Composite NTSC\n");
+
+      full_width = 720;
+      full_height = 480;
+      analog_signal = "ntsc";
+      analog_tv_standard = "ntsc";
+      analog_connector = "yc";  // or scart ?
+    }
+    break;
+
+    case (2):
+    {
+      debug("Mode: Composite PAL\n");
+
+      full_width = 720;
+      full_height = 576;
+      analog_signal = "pal";
+      analog_tv_standard = "pal";
+      analog_connector = "yc";  // or scart ?
+    }
+    break;
+
+    case (3):
+    {
+      debug("Mode: Component NTSC 480i 60Hz\n");
+
+      full_width = 720;
+      full_height = 480;
+      component_signal = "edtv";  // is 480 ntsc / 576 pal
+      component_tv_standard = "hdtv60";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (4):
+    {
+      debug("Mode: Component PAL 576i 50Hz\n");
+
+      full_width = 720;
+      full_height = 576;
+      component_signal = "edtv";  // is 480 ntsc / 576 pal
+      component_tv_standard = "hdtv50";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (5):
+    {
+      debug("Mode: Component 480p 60Hz\n");
+
+      full_width = 720;
+      full_height = 480;
+      //! \todo How to force 480p?
+      component_signal = "edtv";
+      component_tv_standard = "hdtv60";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (6):
+    {
+      debug("Mode: Component 720p 60Hz\n");
+
+      full_width = 1280;
+      full_height = 720;
+      component_signal = "720p";
+      component_tv_standard = "hdtv60";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (7):
+    {
+      debug("Mode: Component 1080p 60Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      component_signal = "1080p";
+      component_tv_standard = "hdtv60";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (8):
+    {
+      debug("Mode: Component 1080i 60Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      component_signal = "1080i";
+      component_tv_standard = "hdtv60";
+      component_connector = "ycrcb";
+    }
+    break;
+
+#if 0
+    case (9):
+    {
+      debug("Mode: HDMI 480p 60Hz\n");
+
+      //! \todo Illegal mode?!? Not supported by DFB?
+
+      full_width = 720;
+      full_height = 480;
+    }
+    break;
+#endif
+
+    case (10):
+    {
+      debug("Mode: HDMI 720p 60Hz\n");
+
+      full_width = 1280;
+      full_height = 720;
+      dtv_signal = "720p";
+      dtv_tv_standard = "hdtv60";
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    case (11):
+    {
+      debug("Mode: Component 1080p 24Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      dtv_signal = "1080p24";
+      dtv_tv_standard = "hdtv60"; // should this also be set?
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    case (13):
+    {
+      debug("Mode: Component 720p 50Hz\n");
+
+      full_width = 1280;
+      full_height = 720;
+      component_signal = "720p";
+      component_tv_standard = "hdtv50";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (14):
+    {
+      debug("Mode: Component 1080p 50Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      component_signal = "1080p";
+      component_tv_standard = "hdtv50";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (15):
+    {
+      debug("Mode: Component 1080i 50Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      component_signal = "1080i";
+      component_tv_standard = "hdtv50";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (16):
+    {
+      debug("Mode: HDMI 720p 50Hz\n");
+
+      full_width = 1280;
+      full_height = 720;
+      dtv_signal = "720p";
+      dtv_tv_standard = "hdtv50";
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    case (18):
+    {
+      debug("Mode: HDMI 1080p 50Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      dtv_signal = "1080p";
+      dtv_tv_standard = "hdtv50";
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    case (29):
+    {
+      debug("Mode: HDMI 1080p 60Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      dtv_signal = "1080p";
+      dtv_tv_standard = "hdtv60";
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    case (30):
+    {
+      debug("Mode: Component 576p 50Hz\n");
+
+      full_width = 720;
+      full_height = 576;
+      //! \todo How to force 576p?
+      component_signal = "edtv";
+      component_tv_standard = "hdtv50";
+      component_connector = "ycrcb";
+    }
+    break;
+
+    case (31):
+    {
+      debug("Mode: HDMI 576p 50Hz\n");
+
+      full_width = 720;
+      full_height = 576;
+      //! \todo Should EDID be used to configure special resolutions?
+      dtv_signal = "edid";
+      dtv_tv_standard = "hdtv50";
+      dtv_connector = "hdmi";
+    }
+    break;
+ 
+    case (32):
+    {
+      debug("Mode: HDMI 1080i 60Hz\n");
+
+      full_width = 1920;
+      full_height = 1080;
+      dtv_signal = "1080i";
+      dtv_tv_standard = "hdtv60";
+      dtv_connector = "hdmi";
+    }
+    break;
+
+    default:
+    {
+      fprintf(stderr, "Unsupported video mode: %d!\n", videoMode);
+      return;
+    }
+    break;
+  }
+
+  // Set resolution (mode)
+	snprintf(dfb_mode, sizeof(dfb_mode), "%dx%d", full_width, full_height);
+  if (DirectFBSetOption("mode", dfb_mode) != DFB_OK)
+  {
+    fprintf(stderr, "Error setting mode: %s\n", dfb_mode);
+    return;
+  }
+
+  // Set which signals should be enabled
+  
+  // dtv
+  if (dtv_signal)
+  {
+		if (DirectFBSetOption ("dtv-signal", dtv_signal) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting dtv-signal: %s\n", dtv_signal);
+      return;
+    }
+
+		if (DirectFBSetOption ("dtv-tv-standard", dtv_tv_standard) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting dtv-tv-standard: %s\n", dtv_tv_standard);
+      return;
+    }
+
+		if (DirectFBSetOption ("dtv-connector", dtv_connector) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting dtv-connector: %s\n", dtv_connector);
+      return;
+    }
+  }
+  else
+  {
+    // Disable dtv signal
+		if (DirectFBSetOption ("dtv-signal", "none") != DFB_OK)
+    {
+      fprintf(stderr, "Error disabling dtv-signal\n");
+      return;
+    }
+  }
+
+  // component
+  if (component_signal)
+  {
+		if (DirectFBSetOption ("component-signal", component_signal) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting component-signal: %s\n", component_signal);
+      return;
+    }
+
+		if (DirectFBSetOption ("component-tv-standard", component_tv_standard) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting component-tv-standard: %s\n", component_tv_standard);
+      return;
+    }
+
+		if (DirectFBSetOption ("component-connector", component_connector) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting component-connector: %s\n", component_connector);
+      return;
+    }
+  }
+  else
+  {
+    // Disable component signal
+		if (DirectFBSetOption ("component-signal", "none") != DFB_OK)
+    {
+      fprintf(stderr, "Error disabling component-signal\n");
+      return;
+    }
+  }
+
+  // analog
+  if (analog_signal)
+  {
+		if (DirectFBSetOption ("analog-signal", analog_signal) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting analog-signal: %s\n", analog_signal);
+      return;
+    }
+
+		if (DirectFBSetOption ("analog-tv-standard", analog_tv_standard) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting analog-tv-standard: %s\n", analog_tv_standard);
+      return;
+    }
+
+		if (DirectFBSetOption ("analog-connector", analog_connector) != DFB_OK)
+    {
+      fprintf(stderr, "Error setting analog-connector: %s\n", analog_connector);
+      return;
+    }
+  }
+  else
+  {
+    // Disable component signal
+		if (DirectFBSetOption ("analog-signal", "none") != DFB_OK)
+    {
+      fprintf(stderr, "Error disabling analog-signal\n");
+      return;
+    }
+  }
+}
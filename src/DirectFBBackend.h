@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIRECTFBBACKEND_H
+#define DIRECTFBBACKEND_H
+
+#include "config.h"
+#include <directfb.h>
+#include "Backend.h"
+
+#ifdef NMT
+#define INPUT_DEVICE DIDID_REMOTE
+#else
+#define INPUT_DEVICE DIDID_KEYBOARD
+#endif
+
+class DirectFBSurface : public Surface
+{
+ private:
+  IDirectFBSurface *m_surface;
+
+ public:
+  DirectFBSurface(IDirectFBSurface *surface);
+  virtual ~DirectFBSurface();
+  IDirectFBSurface *surface() { return m_surface; }
+  virtual void getSize(int *width, int *height);
+  virtual DFBSurfacePixelFormat pixelFormat();
+  virtual void setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+  virtual void setClip(const DFBRegion *clip);
+  virtual void getClip(DFBRegion *clip);
+  virtual void setDrawingFlags(DFBSurfaceDrawingFlags flags);
+  virtual void setBlittingFlags(DFBSurfaceBlittingFlags flags);
+  virtual void fillRectangle(int x, int y, int w, int h);
+  virtual void drawLine(int x1, int y1, int x2, int y2);
+  virtual void blit(Surface *source, const DFBRectangle *rect, int x, int y);
+  virtual void batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num);
+  virtual void flip(const DFBRegion *region, DFBSurfaceFlipFlags flags);
+  virtual bool lock(void **data, int *pitch);
+  virtual void unlock();
+};
+
+class DirectFBBackend : public Backend
+{
+ private:
+  bool m_valid;
+  int m_videoMode;
+  IDirectFB *m_dfb;
+  DirectFBSurface *m_primary;
+  IDirectFBEventBuffer *m_eventBuffer;
+  IDirectFBInputDevice *m_input;
+
+ private:
+  void setVideoMode(int videoMode);
+
+ public:
+  DirectFBBackend(int argc, char **argv, int videoMode=-1);
+  virtual ~DirectFBBackend();
+  bool isValid() { return m_valid; }
+  virtual bool open();
+  virtual void close();
+  virtual Surface *primary() { return m_primary; }
+  virtual Surface *createSurface(DFBSurfaceDescription *dsc);
+  virtual bool decodeImage(const char *path, float scale, DFBSurfaceDescription *dsc);
+  virtual void waitForEvent(int timeout);
+  virtual void wakeUp();
+  virtual bool getEvent(Event *event);
+};
+
+#endif
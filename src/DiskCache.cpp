@@ -0,0 +1,237 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#include "config.h"
+#include "DiskCache.h"
+#include "Utils.h"
+
+struct RawHeader
+{
+  char magic[8];
+  int width;
+  int height;
+  int pitch;
+  int pixelformat;
+  long mtime;
+};
+
+struct CacheFile
+{
+  std::string path;
+  long size;
+  time_t mtime;
+};
+
+static const char raw_magic[8] = "TTVRAW1";
+
+static bool olderFile(const CacheFile &a, const CacheFile &b)
+{
+  return a.mtime < b.mtime;
+}
+
+DiskCache::DiskCache(const char *dir, long budget)
+  : m_dir(dir),
+    m_enabled(true),
+    m_budget(budget),
+    m_bytes(0)
+{
+  struct stat st;
+
+  pthread_mutex_init(&m_mutex, NULL);
+  if (stat(dir, &st) && mkdir(dir, 0755)) {
+    fprintf(stderr, "Cannot create %s, disk cache disabled\n", dir);
+    m_enabled = false;
+    return;
+  }
+  m_bytes = prune(m_budget);
+}
+
+DiskCache::~DiskCache()
+{
+  pthread_mutex_destroy(&m_mutex);
+}
+
+// Deletes the least recently used files until at most limit bytes are
+// left, and returns the bytes left.
+long DiskCache::prune(long limit)
+{
+  std::vector<CacheFile> files;
+  struct dirent *dirp;
+  struct stat st;
+  long total = 0;
+  DIR *dp;
+
+  if (!(dp = opendir(m_dir.c_str()))) return 0;
+  while ((dirp = readdir(dp)) != NULL) {
+    if (dirp->d_name[0] == '.') continue;
+    CacheFile file;
+    file.path = m_dir + "/" + dirp->d_name;
+    if (stat(file.path.c_str(), &st) || !S_ISREG(st.st_mode)) continue;
+    file.size = st.st_size;
+    file.mtime = st.st_mtime;
+    files.push_back(file);
+    total += file.size;
+  }
+  closedir(dp);
+  if (total <= limit) return total;
+
+  std::sort(files.begin(), files.end(), olderFile);
+  for (int i=0; i < (int)files.size() && total > limit; i++) {
+    if (!unlink(files[i].path.c_str())) total -= files[i].size;
+  }
+  debug("disk cache pruned to %ld bytes\n", total);
+  return total;
+}
+
+// Accounts for a file just written to the cache directory.  Going over
+// budget prunes down to three quarters of it, so that the directory is
+// not rescanned on every store.
+void DiskCache::added(const char *file)
+{
+  struct stat st;
+
+  if (stat(file, &st)) return;
+  pthread_mutex_lock(&m_mutex);
+  m_bytes += st.st_size;
+  if (m_bytes > m_budget) m_bytes = prune(m_budget / 4 * 3);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void DiskCache::filename(char *file, int size, const char *path, float scaleFactor, float screenScale)
+{
+  char key[1200];
+  snprintf(key, sizeof(key), "%s|%g|%g|%d", path, scaleFactor, screenScale, (int)DSPF_ARGB);
+  // two independent hashes make accidental collisions practically impossible
+  unsigned h2 = 5381;
+  for (const char *c = key; *c; c++) h2 = h2 * 33 ^ (unsigned char)*c;
+  snprintf(file, size, "%s/%08x%08x.raw", m_dir.c_str(), hash(key), h2);
+}
+
+bool DiskCache::decodeImage(Backend *backend, const char *path, float scaleFactor, float screenScale,
+                            DFBSurfaceDescription *dsc, int *mapped)
+{
+  char file[256];
+  struct stat st;
+
+  *mapped = 0;
+  if (!m_enabled || stat(path, &st))
+    return backend->decodeImage(path, scaleFactor * screenScale, dsc);
+
+  filename(file, sizeof(file), path, scaleFactor, screenScale);
+  if (load(file, st.st_mtime, dsc, mapped))
+    return true;
+
+  if (!backend->decodeImage(path, scaleFactor * screenScale, dsc))
+    return false;
+  if (backend->decodesPixels()) store(file, st.st_mtime, dsc);
+  return true;
+}
+
+bool DiskCache::load(const char *file, long mtime, DFBSurfaceDescription *dsc, int *mapped)
+{
+  RawHeader header;
+  int fd = open(file, O_RDONLY);
+  struct stat st;
+  void *base;
+  int size;
+
+  if (fd < 0) return false;
+  if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, raw_magic, sizeof(raw_magic)) || header.mtime != mtime ||
+      header.width <= 0 || header.height <= 0 || header.pitch < header.width * 4) {
+    close(fd);
+    return false;
+  }
+
+  // a truncated file would fault on the first read past its end
+  size = RAW_HEADER_SIZE + header.pitch * header.height;
+  if (fstat(fd, &st) || st.st_size != size) {
+    debug("discarding damaged cache file %s\n", file);
+    close(fd);
+    return false;
+  }
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+  // a hit counts as a use for prune()
+  utime(file, NULL);
+
+  dsc->flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED);
+  dsc->caps = DSCAPS_SYSTEMONLY;
+  dsc->width = header.width;
+  dsc->height = header.height;
+  dsc->pixelformat = (DFBSurfacePixelFormat)header.pixelformat;
+  dsc->preallocated[0].data = (char *)base + RAW_HEADER_SIZE;
+  dsc->preallocated[0].pitch = header.pitch;
+  dsc->preallocated[1].data = NULL;
+  dsc->preallocated[1].pitch = 0;
+  *mapped = size;
+  return true;
+}
+
+void DiskCache::store(const char *file, long mtime, DFBSurfaceDescription *dsc)
+{
+  RawHeader header;
+  char tmp[256], pad[RAW_HEADER_SIZE];
+  int row = dsc->width * 4;
+  FILE *f;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, raw_magic, sizeof(raw_magic));
+  header.width = dsc->width;
+  header.height = dsc->height;
+  header.pitch = (row + RAW_PITCH_ALIGN - 1) & ~(RAW_PITCH_ALIGN - 1);
+  header.pixelformat = dsc->pixelformat;
+  header.mtime = mtime;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d.%lx", file, (int)getpid(), (unsigned long)pthread_self());
+  if (!(f = fopen(tmp, "wb"))) return;
+
+  memset(pad, 0, sizeof(pad));
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(pad, RAW_HEADER_SIZE - sizeof(header), 1, f) == 1;
+  for (int y=0; ok && y < dsc->height; y++) {
+    ok = fwrite((char *)dsc->preallocated[0].data + y * dsc->preallocated[0].pitch, row, 1, f) == 1;
+    if (ok && header.pitch > row) ok = fwrite(pad, header.pitch - row, 1, f) == 1;
+  }
+  if (fclose(f) || !ok || rename(tmp, file)) {
+    debug("could not write %s\n", file);
+    unlink(tmp);
+    return;
+  }
+  added(file);
+}
+
+void DiskCache::release(void *data, int mapped)
+{
+  if (!data) return;
+  if (mapped) munmap((char *)data - RAW_HEADER_SIZE, mapped);
+  else free(data);
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <pthread.h>
+#include <directfb.h>
+#include <string>
+#include "Backend.h"
+
+#define DISK_CACHE_DIR "/share/Apps/TankTV/cache"
+#define DISK_CACHE_BUDGET (128 * 1024 * 1024)
+#define RAW_HEADER_SIZE 64
+#define RAW_PITCH_ALIGN 16
+
+// Decoded, scaled images stored as raw pixel blobs under DISK_CACHE_DIR,
+// one file per (path, scale factor, screen scale, pixel format).  The
+// source mtime is kept in the header, so an edited image replaces its
+// stale entry.  Hits are mmapped and used as DSDESC_PREALLOCATED data.
+// Once the directory holds more than the budget, the least recently
+// used files are deleted.
+
+class DiskCache
+{
+ private:
+  std::string m_dir;
+  bool m_enabled;
+  long m_budget;
+  long m_bytes;
+  pthread_mutex_t m_mutex;
+
+ private:
+  long prune(long limit);
+  void filename(char *file, int size, const char *path, float scaleFactor, float screenScale);
+  bool load(const char *file, long mtime, DFBSurfaceDescription *dsc, int *mapped);
+  void store(const char *file, long mtime, DFBSurfaceDescription *dsc);
+
+ public:
+  DiskCache(const char *dir=DISK_CACHE_DIR, long budget=DISK_CACHE_BUDGET);
+  ~DiskCache();
+  bool enabled() { return m_enabled; }
+  const char *dir() { return m_dir.c_str(); }
+  void added(const char *file);
+  bool decodeImage(Backend *backend, const char *path, float scaleFactor, float screenScale, 
+                   DFBSurfaceDescription *dsc, int *mapped);
+  static void release(void *data, int mapped);
+};
+
+#endif
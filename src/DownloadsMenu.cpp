@@ -28,9 +28,7 @@ DownloadsMenu::DownloadsMenu(Application *application, const char *title, const
 
 void DownloadsMenu::selectFile(File &file)
 {
-  if (!m_app->audio()->isStopped()) m_app->audio()->close();
-  debug("playing %s\n", file.path());
-  m_app->renderer()->play(file.path());
+  m_app->play(file.path());
 }
 
 void DownloadsMenu::selectDirectory(File &file)
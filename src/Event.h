@@ -58,6 +58,7 @@ class EventListener
  public:
   virtual bool handleEvent(Event &event) { return true; };
   virtual bool handleIdle() { return true; };
+  virtual void handleTimer(int timer) {};
 };
 
 #endif
@@ -22,21 +22,70 @@
 #include "Player.h"
 #include <algorithm>
 
+struct DirectoryJob : public LoadJob
+{
+  std::string path;
+  std::vector<File> files;
+
+  bool run(Database *db)
+  {
+    File::listDirectory(path.c_str(), files);
+    std::sort(files.begin(), files.end());
+    return true;
+  }
+};
+
 FileMenu::FileMenu(Application *application, const char *title, const char *path)
-  : Menu(application, title)
+  : Menu(application, title),
+    m_load(0)
 {
-  if (path) {
-    File::listDirectory(path, m_files);
+  QueryLoader *loader = m_app->loader();
+  DirectoryJob *job = new DirectoryJob();
+
+  if (path) job->path = path;
+  if (path && loader) {
+    m_load = loader->request(job);
+    m_loading = true;
+    return;
   }
+  job->run(NULL);
+  m_files.swap(job->files);
+  delete job;
+  setSource(this);
+}
+
+FileMenu::~FileMenu()
+{
+  if (m_load) m_app->loader()->cancel(m_load);
+}
 
-  std::sort(m_files.begin(), m_files.end());
-  for (int i=0; i < m_files.size(); i++) {
-    File &file = m_files[i];
-    if (file.isDirectory())
-      new ArrowItem(this, file.name(), &file);
-    else if (file.isAudio() || file.isVideo())
-      new MenuItem(this, file.name(), &file);      
+bool FileMenu::handleIdle()
+{
+  DirectoryJob *job;
+
+  if (m_load && (job = (DirectoryJob *)m_app->loader()->finished(m_load))) {
+    m_load = 0;
+    m_loading = false;
+    m_files.swap(job->files);
+    delete job;
+    setSource(this);
+    setDirty();
   }
+  return Menu::handleIdle();
+}
+
+int FileMenu::count()
+{
+  return m_files.size();
+}
+
+MenuItem *FileMenu::row(Menu *menu, int index)
+{
+  File &file = m_files[index];
+
+  if (file.isDirectory())
+    return new ArrowItem(menu, file.name(), &file);
+  return new MenuItem(menu, file.name(), &file);
 }
 
 void FileMenu::selectItem(MenuItem *menuItem)
@@ -48,9 +97,7 @@ void FileMenu::selectItem(MenuItem *menuItem)
   }
   else {
     if (file->isVideo()) {
-      if (!m_app->audio()->isStopped()) m_app->audio()->close();
-      debug("playing %s\n", file->path());
-      m_app->renderer()->play(file->path());
+      m_app->play(file->path());
     }
     else if (file->isAudio()) {
       if (strcmp(m_app->audio()->nowPlaying(), file->path())) {
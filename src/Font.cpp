@@ -17,60 +17,159 @@
   along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "Font.h"
+#include "DiskCache.h"
 #include "Utils.h"
 
+#define GLYPH_HEADER_SIZE 64
+
+struct GlyphCacheHeader
+{
+  char magic[8];
+  long mtime;
+  int size;
+  int num_glyphs;
+  int ascender;
+  int descender;
+  int has_kerning;
+  int num_cached;
+  int num_kerning;
+  int num_pages;
+};
+
+struct CachedGlyph
+{
+  int index;
+  Glyph glyph;
+};
+
+static const char glyph_magic[8] = "TTVGLY3";
+
 FT_Library Font::m_ft_library = NULL;
 
 Font::Font(Renderer *renderer, const char *path, int size)
-  : m_renderer(renderer),
-    m_face(NULL)
+  : m_face(NULL),
+    m_face_failed(false),
+    m_size(size),
+    m_mtime(0),
+    m_valid(false),
+    m_renderer(renderer),
+    m_glyphs(NULL),
+    m_num_glyphs(0),
+    m_ascender(0),
+    m_descender(0),
+    m_has_kerning(false),
+    m_cache_map(NULL),
+    m_cache_size(0),
+    m_cache_dirty(false)
 {
-  if (!path || !path[0]) return;
+  struct stat st;
 
-  FT_Error error;
+  for (int i=0; i < GLYPH_CACHE_CHARS; i++) m_char_index[i] = -1;
+  if (!path || !path[0] || stat(path, &st)) return;
+  m_path = path;
+  m_mtime = st.st_mtime;
 
-  if (!m_ft_library) return;
-  
-  error =  FT_New_Face(m_ft_library, path, 0, &m_face);
-  if (error) { 
-    m_face = NULL;
+  if (m_renderer->diskCache()->enabled() && loadCache()) {
+    m_valid = true;
     return;
   }
-  
-  FT_Set_Char_Size( m_face, 0, size*64, 72, 72);
-
-  /*
-  debug("Loading font: %s (%d pt)\n", path, size);
-  debug("num faces: %d\n", m_face->num_faces);
-  debug("face: %d\n", m_face->face_index);
-  debug("num sizes: %d\n", m_face->num_fixed_sizes);
-  debug("scalable: %d\n", (m_face->face_flags & FT_FACE_FLAG_SCALABLE) != 0);
-  debug("fixed sizes: %d\n", (m_face->face_flags & FT_FACE_FLAG_FIXED_SIZES) != 0);
-  debug("kerning: %d\n", (m_face->face_flags & FT_FACE_FLAG_KERNING) != 0);
-  debug("hinter: %d\n", (m_face->face_flags & FT_FACE_FLAG_HINTER) != 0);
-  debug("fast glyphs: %d\n", (m_face->face_flags & FT_FACE_FLAG_FAST_GLYPHS) != 0);
-  */
-
-  for (int i=0; i < m_face->num_glyphs; i++) {
-    if (FT_Load_Glyph(m_face, i, FT_LOAD_DEFAULT)) continue;
-    if (FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL)) continue;    
-  }
+  if (!face()) return;
+
+  m_num_glyphs = m_face->num_glyphs;
+  m_glyphs = (Glyph *)calloc(m_num_glyphs, sizeof(Glyph));
+  m_ascender = m_face->size->metrics.ascender >> 6;
+  m_descender = m_face->size->metrics.descender >> 6;
+  m_has_kerning = FT_HAS_KERNING(m_face);
+  m_valid = m_glyphs != NULL;
 }
 
 Font::~Font()
 {  
+  if (m_cache_dirty && m_renderer->diskCache()->enabled()) storeCache();
   clearCache();
 
-  for (glyph_map::const_iterator i=m_glyph_cache.begin(); i != m_glyph_cache.end(); i++) {
-    Glyph *glyph = i->second;
-    if (glyph) {
-      if (glyph->dsc.preallocated[0].data)
-	free(glyph->dsc.preallocated[0].data);
-      delete glyph;    
+  for (layout_map::const_iterator i=m_layouts.begin(); i != m_layouts.end(); i++)
+    delete i->second;
+
+  for (int i=0; i < m_pages.size(); i++) {
+    if (!m_pages[i]->mapped) free(m_pages[i]->data);
+    delete m_pages[i];
+  }
+  if (m_cache_map) munmap(m_cache_map, m_cache_size);
+  if (m_glyphs) free(m_glyphs);
+  if (m_face) FT_Done_Face(m_face);
+}
+
+FT_Face Font::face()
+{
+  if (m_face || m_face_failed) return m_face;
+
+  if (!m_ft_library || FT_New_Face(m_ft_library, m_path.c_str(), 0, &m_face)) { 
+    fprintf(stderr, "FreeType: Could not open %s\n", m_path.c_str());
+    m_face = NULL;
+    m_face_failed = true;
+    return NULL;
+  }
+  FT_Set_Char_Size( m_face, 0, m_size*64, 72, 72);
+  debug("opened font %s (%d px)\n", m_path.c_str(), m_size);
+  return m_face;
+}
+
+int Font::charIndex(long ucs)
+{
+  if (ucs >= 0 && ucs < GLYPH_CACHE_CHARS) {
+    if (m_char_index[ucs] < 0) {
+      m_char_index[ucs] = face() ? FT_Get_Char_Index(m_face, ucs) : 0;
+      m_cache_dirty = true;
     }
+    return m_char_index[ucs];
   }
+
+  std::map<long, int>::iterator i = m_char_map.find(ucs);
+  if (i != m_char_map.end()) return i->second;
+  int index = face() ? FT_Get_Char_Index(m_face, ucs) : 0;
+  m_char_map[ucs] = index;
+  return index;
+}
+
+static unsigned long long kerningKey(int left, int right)
+{
+  return ((unsigned long long)(unsigned)left << 32) | (unsigned)right;
+}
+
+int Font::kerning(int left, int right)
+{
+  if (!m_has_kerning || !left || !right) return 0;
+
+  unsigned long long key = kerningKey(left, right);
+  int lo = 0, hi = m_kerning.size();
+
+  // pairs from the glyph cache, zero ones included
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (m_kerning[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < (int)m_kerning.size() && m_kerning[lo].key == key) return m_kerning[lo].x;
+
+  std::map<unsigned long long, int>::iterator i = m_kerning_cache.find(key);
+  if (i != m_kerning_cache.end()) return i->second;
+
+  FT_Vector delta;
+  int x = 0;
+  if (face() && !FT_Get_Kerning(m_face, left, right, ft_kerning_default, &delta)) x = (int)(delta.x >> 6);
+  m_kerning_cache[key] = x;
+  m_cache_dirty = true;
+  return x;
 }
 
 void Font::init()
@@ -93,136 +192,230 @@ void Font::finish()
 
 Glyph *Font::getGlyph(int index)
 {
-  Glyph *glyph = NULL;
+  if (index < 0 || index >= m_num_glyphs) return NULL;
 
-  if (m_glyph_cache.find(index) == m_glyph_cache.end()) {
-    if (!FT_Load_Glyph(m_face, index, FT_LOAD_DEFAULT) &&
-	!FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL)) {
-      glyph = new Glyph;
-      glyph->surface = NULL;
+  Glyph *glyph = &m_glyphs[index];
 
+  if (!glyph->loaded) {
+    glyph->loaded = true;
+    glyph->page = -1;
+    m_cache_dirty = true;
+    if (face() && !FT_Load_Glyph(m_face, index, FT_LOAD_DEFAULT) &&
+	!FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL)) {
       FT_GlyphSlot  slot = m_face->glyph; 
-      FT_Bitmap *bitmap = &slot->bitmap;
-      unsigned char *dst, *src = bitmap->buffer;
-      int width = bitmap->width;
-      int height = bitmap->rows;
-      DFBSurfaceDescription &dsc = glyph->dsc;
-
-      dsc.flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED);
-      dsc.caps = DSCAPS_NONE;
-      dsc.width = width;
-      dsc.height = height;
-      dsc.pixelformat = DSPF_A8;
-      if (width && height && (dsc.preallocated[0].data = malloc(width * height))) {
-	memcpy(dsc.preallocated[0].data, src, width * height);
-	dsc.preallocated[0].pitch = width;
-	dsc.preallocated[1].data = NULL;
-	dsc.preallocated[1].pitch = 0;
-	glyph->surface = m_renderer->createSurface(&dsc);
-      }
-      else {
-	dsc.preallocated[0].data = NULL;
-      }
+
+      glyph->valid = true;
       glyph->left = slot->bitmap_left;
       glyph->top = slot->bitmap_top;
       glyph->advance_x = slot->advance.x >> 6;
       glyph->advance_y = slot->advance.y >> 6;
+      if (slot->bitmap.width && slot->bitmap.rows && !pack(glyph, &slot->bitmap))
+        fprintf(stderr, "Glyph %d does not fit in the font atlas\n", index);
     }
-    m_glyph_cache[index] = glyph;
   }
-  if ((glyph = m_glyph_cache[index]))
-    if (!glyph->surface && glyph->dsc.preallocated[0].data)
-      glyph->surface = m_renderer->createSurface(&glyph->dsc);
-  return glyph;
+  return glyph->valid ? glyph : NULL;
 }
 
-int Font::decodeUTF8(const char *bytes, long *ucs, int ucs_max_len)
+bool Font::pack(Glyph *glyph, FT_Bitmap *bitmap)
 {
-  if (!bytes) return 0;
-  int num_bytes = strlen(bytes), num_chars=0, i=0;
-  unsigned char *b = (unsigned char *)bytes;
-  
-  bytes += num_bytes;
-  while(b < (unsigned char *)bytes && num_chars < ucs_max_len) {
-    if(*b<=127) ucs[num_chars++] = *b;
-    else if(*b<=192) { printf("invalid utf-8 data\n"); }
-    else if(*b<=223) ucs[num_chars++] = ((*b-192)<<6) + (*++b-128);
-    else if(*b<=239) ucs[num_chars++] = ((*b-224)<<12) + ((*++b-128)<<6) + (*++b-128);
-    else if(*b<=247) ucs[num_chars++] = ((*b-240)<<18) + ((*++b-128)<<12) + ((*++b-128)<<6) + (*++b-128);
-    else if(*b<=251) 
-      ucs[num_chars++] = ((*b-248)<<24) + ((*++b-128)<<18) + ((*++b-128)<<12) + ((*++b-128)<<6) + (*++b-128);
-    else if(*b<=253)
-      ucs[num_chars++] = ((*b-252)<<30) + ((*++b-128)<<24)  + ((*++b-128)<<18) + ((*++b-128)<<12) + ((*++b-128)<<6) + (*++b-128);
-    else { printf("invalid utf-8 data\n"); }
-    b++;
-  }  
-  return num_chars;
+  int width = bitmap->width, height = bitmap->rows;
+  int page, shelf = -1;
+
+  if (width > FONT_ATLAS_SIZE || height > FONT_ATLAS_SIZE) return false;
+
+  // Use the lowest shelf that is tall enough and has room left, otherwise
+  // open a new shelf, and failing that a new page.
+  for (page=0; page < m_pages.size(); page++) {
+    std::vector<GlyphShelf> &shelves = m_pages[page]->shelves;
+    for (int i=0; i < shelves.size(); i++) {
+      if (shelves[i].height >= height && shelves[i].x + width <= FONT_ATLAS_SIZE &&
+          (shelf < 0 || shelves[i].height < shelves[shelf].height))
+        shelf = i;
+    }
+    if (shelf >= 0) break;
+    if (m_pages[page]->bottom + height <= FONT_ATLAS_SIZE) {
+      GlyphShelf s = { 0, m_pages[page]->bottom, height };
+      m_pages[page]->bottom += height;
+      shelves.push_back(s);
+      shelf = shelves.size() - 1;
+      break;
+    }
+  }
+  if (page == m_pages.size()) {
+    unsigned char *data = (unsigned char *)calloc(FONT_ATLAS_SIZE, FONT_ATLAS_SIZE);
+    if (!data) return false;
+    AtlasPage *p = new AtlasPage(data, false, height);
+    GlyphShelf s = { 0, 0, height };
+    p->shelves.push_back(s);
+    m_pages.push_back(p);
+    shelf = 0;
+  }
+
+  AtlasPage &p = *m_pages[page];
+  GlyphShelf &s = p.shelves[shelf];
+  glyph->page = page;
+  glyph->x = s.x;
+  glyph->y = s.y;
+  glyph->width = width;
+  glyph->height = height;
+  s.x += width;
+
+  for (int row=0; row < height; row++)
+    memcpy(p.data + (glyph->y + row) * FONT_ATLAS_SIZE + glyph->x, bitmap->buffer + row * bitmap->pitch, width);
+
+  if (p.surface) {
+    unsigned char *data;
+    int pitch;
+    if (p.surface->lock((void **)&data, &pitch)) {
+      for (int row=0; row < height; row++)
+        memcpy(data + (glyph->y + row) * pitch + glyph->x, p.data + (glyph->y + row) * FONT_ATLAS_SIZE + glyph->x, width);
+      p.surface->unlock();
+    }
+  }
+  return true;
+}
+
+Surface *AtlasPage::upload(Renderer *renderer)
+{
+  unsigned char *pixels;
+  int pitch;
+
+  if (surface || !(surface = renderer->createSurface(FONT_ATLAS_SIZE, FONT_ATLAS_SIZE, DSPF_A8)))
+    return surface;
+  if (surface->lock((void **)&pixels, &pitch)) {
+    for (int row=0; row < FONT_ATLAS_SIZE; row++)
+      memcpy(pixels + row * pitch, data + row * FONT_ATLAS_SIZE, FONT_ATLAS_SIZE);
+    surface->unlock();
+  }
+  renderer->residency()->add(this, FONT_ATLAS_SIZE * FONT_ATLAS_SIZE);
+  return surface;
+}
+
+Surface *Font::pageSurface(int page)
+{
+  AtlasPage *p = m_pages[page];
+
+  if (!p->surface) return p->upload(m_renderer);
+  m_renderer->residency()->touch(p);
+  return p->surface;
 }
 
-int Font::getWidth(long *ucs, int *ucs_length, int max_width, bool hardclip)
+// Shapes ucs into layout.  Text wider than max_width is cut short, with
+// an ellipsis unless hardclip is set, and reported as max_width wide.
+void Font::shape(const long *ucs, int num_chars, int max_width, bool hardclip, TextLayout *layout)
 {
-  if (!m_face) return 0;
+  std::vector<ShapedGlyph> &run = layout->run;
+
+  layout->font = this;
+  layout->width = 0;
+  run.clear();
+  if (!m_valid) return;
 
-  FT_UInt index, previous = 0;
-  FT_Bool use_kerning = FT_HAS_KERNING(m_face);
-  int num_chars = *ucs_length, width = 0, ellipsis_width = 0, ellipsis_n = -999;
+  int previous = 0, width = 0, ellipsis_width = 0, ellipsis_n = -1;
+  int dot = charIndex('.');
   Glyph *glyph;
 
-  if ((glyph = getGlyph(FT_Get_Char_Index( m_face, '.' )))) {
+  if ((glyph = getGlyph(dot))) {
     ellipsis_width = glyph->advance_x * 3;
   }   
 
   for (int n=0; n < num_chars; n++) {
-    if (ellipsis_n < -1 && width + ellipsis_width >= max_width) 
+    if (max_width && ellipsis_n < 0 && width + ellipsis_width >= max_width) 
       ellipsis_n = n-1;
-    index = FT_Get_Char_Index( m_face, ucs[n] );
-    if (use_kerning && previous && index) {
-      FT_Vector delta;
-      FT_Get_Kerning( m_face, previous, index, ft_kerning_default, &delta );
-      width += delta.x >> 6;
-    }  
+    int index = charIndex(ucs[n]);
+    width += kerning(previous, index);
+    ShapedGlyph shaped = { index, width };
+    run.push_back(shaped);
     if ((glyph = getGlyph(index))) {
       width += glyph->advance_x;
     }   
+    previous = index;
     if (max_width && width > max_width) {
-      if (!hardclip) {
-	if (ellipsis_n > 0 && ellipsis_n < MAX_TEXT_LENGTH - 4) {
-	  ucs[ellipsis_n] = ucs[ellipsis_n+1] = ucs[ellipsis_n+2] = '.';
-	  ucs[ellipsis_n+3] = 0;
-	  *ucs_length = ellipsis_n + 3;
-	}
+      if (!hardclip && ellipsis_n > 0) {
+        run.resize(ellipsis_n);
+        previous = run.back().index;
+        width = run.back().x + ((glyph = getGlyph(previous)) ? glyph->advance_x : 0);
+        for (int i=0; i < 3; i++) {
+          width += kerning(previous, dot);
+          ShapedGlyph shaped = { dot, width };
+          run.push_back(shaped);
+          width += ellipsis_width / 3;
+          previous = dot;
+        }
       }
-      return max_width; 	
+      layout->width = max_width;
+      return;
     }
   }
-  return width;
+  layout->width = width;
+}
+
+// The memoized layout of text.  The reference is only good until the
+// next layout is shaped, which may recycle its entry.
+const TextLayout &Font::shaped(const char *text, int max_width, bool hardclip)
+{
+  LayoutKey key;
+  key.hash = hash(text ? text : "");
+  key.max_width = max_width;
+  key.hardclip = hardclip;
+  key.text = text ? text : "";
+
+  layout_map::iterator i = m_layouts.find(key);
+  if (i != m_layouts.end()) {
+    m_layout_lru.splice(m_layout_lru.begin(), m_layout_lru, i->second->lru);
+    return i->second->layout;
+  }
+
+  LayoutEntry *entry;
+  if (m_layouts.size() < FONT_LAYOUT_CACHE_SIZE) {
+    entry = new LayoutEntry;
+  }
+  else {
+    entry = m_layout_lru.back();
+    m_layout_lru.pop_back();
+    m_layouts.erase(entry->entry);
+  }
+
+  // A UTF-8 string never has more characters than bytes.
+  if (m_ucs.size() < key.text.size() + 1) m_ucs.resize(key.text.size() + 1);
+  int num_chars = decodeUTF8(key.text.c_str(), key.text.size(), &m_ucs[0], m_ucs.size());
+  shape(&m_ucs[0], num_chars, max_width, hardclip, &entry->layout);
+
+  entry->entry = m_layouts.insert(std::make_pair(key, entry)).first;
+  m_layout_lru.push_front(entry);
+  entry->lru = m_layout_lru.begin();
+  return entry->layout;
+}
+
+// A copy of the layout of text, for callers that keep it.
+TextLayout Font::layout(const char *text, int max_width, bool hardclip)
+{
+  return shaped(text, max_width, hardclip);
 }
 
 int Font::width(const char *text)
 {
   if (!text) return 0;
-  long ucs[MAX_TEXT_LENGTH];
-  int num_chars = decodeUTF8(text, ucs, sizeof(ucs)/sizeof(long));  
-  return getWidth(ucs, &num_chars);  
+  return shaped(text, 0, false).width;
 }
 
-void Font::draw( int x, int y, const char *text, int max_width, FontJustify justify, bool hardclip)
+void Font::draw( int x, int y, const char *text, int max_width, FontJustify justify, bool hardclip, DFBRegion *extent)
 {
-  if (!m_face) return;
+  draw(x, y, shaped(text, max_width, hardclip), justify, extent);
+}
 
-  FT_UInt index, previous = 0;
-  FT_Bool use_kerning = FT_HAS_KERNING(m_face);
-  long ucs[MAX_TEXT_LENGTH];
+void Font::draw(int x, int y, const TextLayout &layout, FontJustify justify, DFBRegion *extent)
+{
+  if (!m_valid) return;
+
+  const std::vector<ShapedGlyph> &run = layout.run;
   Glyph *glyph;
-  int num_chars = decodeUTF8(text, ucs, sizeof(ucs)/sizeof(long));
-  IDirectFBSurface *primary = m_renderer->surface();
+  Surface *primary = m_renderer->surface();
   DFBRegion clip, textclip;
-  int text_width = getWidth(ucs, &num_chars, max_width, hardclip);
-
-  
+  int text_width = layout.width;
 
-  primary->GetClip(primary, &clip);
-  primary->GetClip(primary, &textclip);
+  primary->getClip(&clip);
+  textclip = clip;
 
   switch (justify) {
   case JUSTIFY_LEFT: 
@@ -240,40 +433,223 @@ void Font::draw( int x, int y, const char *text, int max_width, FontJustify just
     break;
   }
 
-  primary->SetClip(primary, &textclip);    
+  if (extent) {
+    extent->x1 = textclip.x1;
+    extent->x2 = textclip.x2;
+    extent->y1 = maximum(textclip.y1, y - m_ascender);
+    extent->y2 = minimum(textclip.y2, y - m_descender);
+  }
+
+  primary->setClip(&textclip);    
   
-  primary->SetBlittingFlags(primary, (DFBSurfaceBlittingFlags)(DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE)); 
+  primary->setBlittingFlags((DFBSurfaceBlittingFlags)(DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE)); 
+
+  // Runs of glyphs from the same atlas page go out as one batch.
+  DFBRectangle rects[FONT_BATCH_SIZE];
+  DFBPoint points[FONT_BATCH_SIZE];
+  int num = 0, page = -1;
+
+  for (int n=0; n < run.size(); n++) {
+    if ((glyph = getGlyph(run[n].index)) && glyph->page >= 0) {
+      if (num && (glyph->page != page || num == FONT_BATCH_SIZE)) {
+        Surface *surface = pageSurface(page);
+        if (surface) primary->batchBlit(surface, rects, points, num);
+        num = 0;
+      }
+      page = glyph->page;
+      rects[num].x = glyph->x;
+      rects[num].y = glyph->y;
+      rects[num].w = glyph->width;
+      rects[num].h = glyph->height;
+      points[num].x = x + run[n].x + glyph->left;
+      points[num].y = y - glyph->top;
+      num++;
+    }
+  }
+  if (num) {
+    Surface *surface = pageSurface(page);
+    if (surface) primary->batchBlit(surface, rects, points, num);
+  }
 
-  for (int n=0; n < num_chars; n++) {
-    index = FT_Get_Char_Index( m_face, ucs[n] );
+  primary->setBlittingFlags(DSBLIT_NOFX);
+  primary->setClip(&clip);
+}
+
+// Composites the glyphs of text into a new A8 surface whose baseline is
+// ascent pixels from the top.
+Surface *Font::render(const char *text, int max_width, int *width, int *height, int *ascent)
+{
+  *width = *height = *ascent = 0;
+  if (!m_valid) return NULL;
 
-    if (use_kerning && previous && index) {
-      FT_Vector delta;
-      FT_Get_Kerning( m_face, previous, index, ft_kerning_default, &delta );
-      x += delta.x >> 6;
+  const TextLayout &text_layout = shaped(text, max_width, false);
+  const std::vector<ShapedGlyph> &run = text_layout.run;
+  Glyph *glyph;
+  int text_width = text_layout.width;
+  int top = m_ascender;
+  int bottom = -m_descender;
+  Surface *surface = m_renderer->createSurface(text_width, top + bottom, DSPF_A8);
+  unsigned char *data;
+  int pitch;
+
+  if (!surface) return NULL;
+  if (!surface->lock((void **)&data, &pitch)) {
+    delete surface;
+    return NULL;
+  }
+  for (int row=0; row < top + bottom; row++)
+    memset(data + row * pitch, 0, text_width);
+
+  for (int n=0; n < run.size(); n++) {
+    if ((glyph = getGlyph(run[n].index)) && glyph->page >= 0) {
+      unsigned char *src = m_pages[glyph->page]->data + glyph->y * FONT_ATLAS_SIZE + glyph->x;
+      int gx = run[n].x + glyph->left, gy = top - glyph->top;
+      for (int row=maximum(0, -gy); row < glyph->height && gy + row < top + bottom; row++) {
+        unsigned char *s = src + row * FONT_ATLAS_SIZE;
+        unsigned char *d = data + (gy + row) * pitch;
+        for (int col=maximum(0, -gx); col < glyph->width && gx + col < text_width; col++) {
+          // Overlapping edges combine like blended blits would.
+          d[gx + col] += s[col] * (255 - d[gx + col]) / 255;
+        }
+      }
     }
-    
-    if ((glyph = getGlyph(index))) {
-      if (glyph->surface)
-	primary->Blit(primary, glyph->surface, NULL, x + glyph->left, y - glyph->top);
-      x += glyph->advance_x;
-      y += glyph->advance_y;
-    }   
-    
-    previous = index;
   }
+  surface->unlock();
 
-  primary->SetBlittingFlags(primary, DSBLIT_NOFX);
-  primary->SetClip(primary, &clip);
+  *width = text_width;
+  *height = top + bottom;
+  *ascent = top;
+  return surface;
 }
 
-void Font::clearCache()
+void Font::cacheFile(char *file, int size)
+{
+  snprintf(file, size, "%s/%08x-%d.glyphs", m_renderer->diskCache()->dir(), hash(m_path.c_str()), m_size);
+}
+
+bool Font::loadCache()
+{
+  GlyphCacheHeader header;
+  struct stat st;
+  char file[256];
+  char *base;
+  int fd, size;
+
+  cacheFile(file, sizeof(file));
+  if ((fd = open(file, O_RDONLY)) < 0) return false;
+  if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, glyph_magic, sizeof(glyph_magic)) || 
+      header.mtime != m_mtime || header.size != m_size) {
+    close(fd);
+    return false;
+  }
+
+  size = GLYPH_HEADER_SIZE + GLYPH_CACHE_CHARS * sizeof(int) + header.num_cached * sizeof(CachedGlyph) +
+    header.num_kerning * sizeof(KerningPair) + header.num_pages * (sizeof(int) + FONT_ATLAS_SIZE * FONT_ATLAS_SIZE);
+  if (fstat(fd, &st) || st.st_size != size) {
+    close(fd);
+    return false;
+  }
+  // private and writable, so glyphs can still be packed into the pages
+  base = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+  if (!(m_glyphs = (Glyph *)calloc(header.num_glyphs, sizeof(Glyph)))) {
+    munmap(base, size);
+    return false;
+  }
+  m_cache_map = base;
+  m_cache_size = size;
+  m_num_glyphs = header.num_glyphs;
+  m_ascender = header.ascender;
+  m_descender = header.descender;
+  m_has_kerning = header.has_kerning;
+
+  char *p = base + GLYPH_HEADER_SIZE;
+  memcpy(m_char_index, p, GLYPH_CACHE_CHARS * sizeof(int));
+  p += GLYPH_CACHE_CHARS * sizeof(int);
+  for (int i=0; i < header.num_cached; i++, p += sizeof(CachedGlyph)) {
+    CachedGlyph *cached = (CachedGlyph *)p;
+    if (cached->index >= 0 && cached->index < m_num_glyphs)
+      m_glyphs[cached->index] = cached->glyph;
+  }
+  m_kerning.assign((KerningPair *)p, (KerningPair *)p + header.num_kerning);
+  p += header.num_kerning * sizeof(KerningPair);
+  // Glyphs loaded later go on new shelves below the packed part.
+  int *bottom = (int *)p;
+  p += header.num_pages * sizeof(int);
+  for (int i=0; i < header.num_pages; i++, p += FONT_ATLAS_SIZE * FONT_ATLAS_SIZE) {
+    m_pages.push_back(new AtlasPage((unsigned char *)p, true, bottom[i]));
+  }
+  return true;
+}
+
+static bool compareKerning(const KerningPair &a, const KerningPair &b)
 {
-  for (glyph_map::const_iterator i=m_glyph_cache.begin(); i != m_glyph_cache.end(); i++) {
-    Glyph *glyph = i->second;
-    if (glyph && glyph->surface) {
-      glyph->surface->Release(glyph->surface);
-      glyph->surface = NULL;
+  return a.key < b.key;
+}
+
+// Writes out everything looked up so far: the glyphs loaded, with the
+// pages they were packed into, and the kerning pairs used.
+void Font::storeCache()
+{
+  GlyphCacheHeader header;
+  std::vector<CachedGlyph> cached;
+  std::vector<KerningPair> kerning(m_kerning);
+  char file[256], tmp[256], pad[GLYPH_HEADER_SIZE];
+  FILE *f;
+
+  for (int i=0; i < m_num_glyphs; i++) {
+    if (m_glyphs[i].loaded) {
+      CachedGlyph entry = { i, m_glyphs[i] };
+      cached.push_back(entry);
     }
-  }  
+  }
+  for (std::map<unsigned long long, int>::const_iterator i=m_kerning_cache.begin(); i != m_kerning_cache.end(); i++) {
+    KerningPair pair = { i->first, i->second };
+    kerning.push_back(pair);
+  }
+  std::sort(kerning.begin(), kerning.end(), compareKerning);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, glyph_magic, sizeof(glyph_magic));
+  header.mtime = m_mtime;
+  header.size = m_size;
+  header.num_glyphs = m_num_glyphs;
+  header.ascender = m_ascender;
+  header.descender = m_descender;
+  header.has_kerning = m_has_kerning;
+  header.num_cached = cached.size();
+  header.num_kerning = kerning.size();
+  header.num_pages = m_pages.size();
+
+  cacheFile(file, sizeof(file));
+  snprintf(tmp, sizeof(tmp), "%s.%d", file, (int)getpid());
+  if (!(f = fopen(tmp, "wb"))) return;
+
+  memset(pad, 0, sizeof(pad));
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(pad, GLYPH_HEADER_SIZE - sizeof(header), 1, f) == 1 &&
+    fwrite(m_char_index, sizeof(m_char_index), 1, f) == 1;
+  if (ok && !cached.empty()) ok = fwrite(&cached[0], sizeof(CachedGlyph), cached.size(), f) == cached.size();
+  if (ok && !kerning.empty()) ok = fwrite(&kerning[0], sizeof(KerningPair), kerning.size(), f) == kerning.size();
+  for (int i=0; ok && i < (int)m_pages.size(); i++)
+    ok = fwrite(&m_pages[i]->bottom, sizeof(int), 1, f) == 1;
+  for (int i=0; ok && i < (int)m_pages.size(); i++)
+    ok = fwrite(m_pages[i]->data, FONT_ATLAS_SIZE * FONT_ATLAS_SIZE, 1, f) == 1;
+
+  if (fclose(f) || !ok || rename(tmp, file)) {
+    fprintf(stderr, "Cannot write glyph cache %s\n", file);
+    unlink(tmp);
+    return;
+  }
+  m_renderer->diskCache()->added(file);
+}
+
+void Font::clearCache()
+{
+  for (int i=0; i < m_pages.size(); i++) {
+    m_renderer->residency()->remove(m_pages[i]);
+    m_pages[i]->evict();
+  }
 }
@@ -22,44 +22,168 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
 #include "config.h"
 #include "Renderer.h"
 
-#define MAX_TEXT_LENGTH 2048
+// Enough to keep every label of a long menu shaped while it scrolls.
+#define FONT_LAYOUT_CACHE_SIZE 1024
+#define FONT_ATLAS_SIZE 256
+#define FONT_BATCH_SIZE 64
+#define GLYPH_CACHE_CHARS 256
 
 struct Glyph
 {
-  IDirectFBSurface *surface;
-  DFBSurfaceDescription dsc;
+  bool loaded;
+  bool valid;
+  short page;
+  short x;
+  short y;
+  short width;
+  short height;
   int left;
   int top;
   int advance_x;
   int advance_y;
 };
 
-typedef std::map<int, Glyph *> glyph_map;
+struct GlyphShelf
+{
+  int x;
+  int y;
+  int height;
+};
+
+// Glyph bitmaps are shelf packed into A8 atlas pages.  The system memory
+// copy of a page outlives its surface, which is recreated on demand after
+// clearCache() or eviction from video memory.
+
+struct AtlasPage : public Resident
+{
+  unsigned char *data;
+  bool mapped;
+  Surface *surface;
+  std::vector<GlyphShelf> shelves;
+  int bottom;
+
+  AtlasPage(unsigned char *d, bool m, int b) 
+    : Resident(RESIDENT_GLYPHS), data(d), mapped(m), surface(NULL), bottom(b) {}
+  Surface *upload(Renderer *renderer);
+  virtual void evict() { delete surface; surface = NULL; }
+};
+
+// Keyed by both glyph indices, which may each need all 32 bits.
+struct KerningPair
+{
+  unsigned long long key;
+  int x;
+};
+
+// A glyph placed on the pen line, x relative to the start of the run.
+struct ShapedGlyph
+{
+  int index;
+  int x;
+};
+
+class Font;
+
+// Shaped, possibly ellipsized text.  Layouts can be copied and kept by
+// callers; they stay valid for the lifetime of their font.
+struct TextLayout
+{
+  Font *font;
+  int width;
+  std::vector<ShapedGlyph> run;
+};
+
+struct LayoutKey
+{
+  unsigned hash;
+  int max_width;
+  bool hardclip;
+  std::string text;
+
+  bool operator<(const LayoutKey &key) const {
+    if (hash != key.hash) return hash < key.hash;
+    if (max_width != key.max_width) return max_width < key.max_width;
+    if (hardclip != key.hardclip) return hardclip < key.hardclip;
+    return text < key.text;
+  }
+};
+
+struct LayoutEntry;
+typedef std::map<LayoutKey, LayoutEntry *> layout_map;
+
+struct LayoutEntry
+{
+  TextLayout layout;
+  layout_map::iterator entry;
+  std::list<LayoutEntry *>::iterator lru;
+};
+
+// Glyphs are rasterized and kerning pairs looked up on first use.  The
+// FreeType face is only opened once one is needed that the on-disk glyph
+// cache does not cover.  The cache holds what earlier runs used of one
+// face at one size: Latin-1 glyph indices, glyph metrics with their atlas
+// pages, and kerning pairs.  It is rewritten when the font is deleted if
+// anything was added, and skipped when the disk cache is disabled.
 
 class Font
 {
  private:
   static FT_Library m_ft_library;
   FT_Face m_face;
+  bool m_face_failed;
+  std::string m_path;
+  int m_size;
+  long m_mtime;
+  bool m_valid;
   Renderer *m_renderer;
-  glyph_map m_glyph_cache;  
-  int decodeUTF8(const char *bytes, long *ucs, int ucs_max_length);
+  Glyph *m_glyphs;
+  int m_num_glyphs;
+  int m_ascender;
+  int m_descender;
+  bool m_has_kerning;
+  int m_char_index[GLYPH_CACHE_CHARS];
+  std::map<long, int> m_char_map;
+  std::vector<KerningPair> m_kerning;
+  std::map<unsigned long long, int> m_kerning_cache;
+  layout_map m_layouts;
+  std::list<LayoutEntry *> m_layout_lru;
+  std::vector<long> m_ucs;
+  std::vector<AtlasPage *> m_pages;
+  void *m_cache_map;
+  int m_cache_size;
+  bool m_cache_dirty;
 
  private:
+  FT_Face face();
+  bool loadCache();
+  void storeCache();
+  void cacheFile(char *file, int size);
+  int charIndex(long ucs);
+  int kerning(int left, int right);
   Glyph *getGlyph(int index);
-  int getWidth(long *ucs, int *ucs_length, int max_width=0, bool hardclip=false);
+  bool pack(Glyph *glyph, FT_Bitmap *bitmap);
+  Surface *pageSurface(int page);
+  void shape(const long *ucs, int num_chars, int max_width, bool hardclip, TextLayout *layout);
+  const TextLayout &shaped(const char *text, int max_width, bool hardclip);
 
  public:
   Font(Renderer *renderer, const char *path, int size);
   ~Font();
   static void init();
   static void finish();
-  bool isValid() { return m_face != NULL; }
-  void draw(int x, int y, const char *text, int width=0, FontJustify justify=JUSTIFY_LEFT, bool hardclip=false);
+  bool isValid() { return m_valid; }
+  TextLayout layout(const char *text, int max_width=0, bool hardclip=false);
+  void draw(int x, int y, const char *text, int width=0, FontJustify justify=JUSTIFY_LEFT, bool hardclip=false, DFBRegion *extent=NULL);
+  void draw(int x, int y, const TextLayout &layout, FontJustify justify=JUSTIFY_LEFT, DFBRegion *extent=NULL);
   int width(const char *text);
+  Surface *render(const char *text, int max_width, int *width, int *height, int *ascent);
   void clearCache();
 };
 
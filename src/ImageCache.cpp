@@ -0,0 +1,151 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include "config.h"
+#include "ImageCache.h"
+#include "DiskCache.h"
+#include "Utils.h"
+
+void Image::evict()
+{
+  if (surface) delete surface;
+  surface = NULL;
+  video = false;
+}
+
+ImageCache::ImageCache(Residency *residency, int systemBudget)
+  : m_residency(residency),
+    m_system_budget(systemBudget),
+    m_system_bytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+}
+
+ImageCache::~ImageCache()
+{
+  debug("image cache: %d hits, %d misses, %d evictions\n", m_hits, m_misses, m_evictions);
+  for (image_map::const_iterator i=m_images.begin(); i != m_images.end(); i++) {
+    releaseSurface(i->second);
+    releaseData(i->second);
+    delete i->second;
+  }
+}
+
+Image *ImageCache::get(const char *path, float scale)
+{
+  ImageKey key(path, scale);
+  image_map::iterator i = m_images.find(key);
+  Image *image;
+
+  if (i == m_images.end()) {
+    image = new Image;
+    image->surface = NULL;
+    image->dsc.preallocated[0].data = NULL;
+    image->mapped = 0;
+    image->path = path;
+    image->scale = scale;
+    image->loaded = false;
+    image->pending = false;
+    image->video = false;
+    image->system_bytes = 0;
+    image->refs = 0;
+    m_lru.push_front(image);
+    image->cached = m_lru.begin();
+    m_images[key] = image;
+  }
+  else {
+    image = i->second;
+    m_lru.splice(m_lru.begin(), m_lru, image->cached);
+  }
+
+  if (image->loaded) m_hits++;
+  else m_misses++;
+  return image;
+}
+
+// Like get(), but the record is kept for the lifetime of the cache.
+Image *ImageCache::hold(const char *path, float scale)
+{
+  Image *image = get(path, scale);
+
+  image->refs++;
+  return image;
+}
+
+void ImageCache::touch(Image *image)
+{
+  m_lru.splice(m_lru.begin(), m_lru, image->cached);
+  if (image->loaded) m_hits++;
+  else m_misses++;
+}
+
+void ImageCache::update(Image *image)
+{
+  m_system_bytes -= image->system_bytes;
+  image->system_bytes = 0;
+  if (image->dsc.preallocated[0].data)
+    image->system_bytes = image->dsc.height * image->dsc.preallocated[0].pitch;
+  m_system_bytes += image->system_bytes;
+  trim(image);
+}
+
+void ImageCache::releaseSurface(Image *image)
+{
+  m_residency->remove(image);
+  image->evict();
+}
+
+void ImageCache::releaseData(Image *image)
+{
+  DiskCache::release(image->dsc.preallocated[0].data, image->mapped);
+  image->dsc.preallocated[0].data = NULL;
+  image->mapped = 0;
+  m_system_bytes -= image->system_bytes;
+  image->system_bytes = 0;
+}
+
+void ImageCache::trim(Image *keep)
+{
+  std::list<Image *>::iterator i = m_lru.end();
+
+  while (i != m_lru.begin() && m_system_bytes > m_system_budget) {
+    Image *image = *--i;
+    if (image == keep || !image->system_bytes) continue;
+
+    debug("evicting %s\n", image->path.c_str());
+    releaseSurface(image);
+    releaseData(image);
+    image->loaded = false;
+    m_evictions++;
+    if (image->refs || image->pending) continue;
+
+    m_images.erase(ImageKey(image->path.c_str(), image->scale));
+    i = m_lru.erase(i);
+    delete image;
+  }
+}
+
+void ImageCache::releaseSurfaces()
+{
+  for (image_map::const_iterator i=m_images.begin(); i != m_images.end(); i++)
+    releaseSurface(i->second);
+}
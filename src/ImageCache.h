@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <map>
+#include <list>
+#include <string>
+#include <directfb.h>
+#include "Surface.h"
+#include "Residency.h"
+
+#define IMAGE_CACHE_SYSTEM_BUDGET (32*1024*1024)
+
+struct Image : public Resident
+{
+  DFBSurfaceDescription dsc;
+  Surface *surface;
+  int mapped;
+  std::string path;
+  float scale;
+  bool loaded;
+  bool pending;
+  bool video;
+  int system_bytes;
+  int refs;
+  std::list<Image *>::iterator cached;
+
+  Image() : Resident(RESIDENT_IMAGE) {}
+  virtual void evict();
+};
+
+struct ImageKey
+{
+  std::string path;
+  float scale;
+
+  ImageKey(const char *p, float s) : path(p), scale(s) {}
+  bool operator<(const ImageKey &key) const {
+    int c = path.compare(key.path);
+    return c < 0 || (c == 0 && scale < key.scale);
+  }
+};
+
+typedef std::map<ImageKey, Image *> image_map;
+
+// Least recently used images lose their system memory copy (which then
+// has to be decoded again) once the system budget is exceeded.  Video
+// surfaces are managed by the Residency.  An evicted record is deleted
+// too, unless a handle holds it or it is pending a background load, so
+// other pointers to records only last until the cache is next updated.
+
+class ImageCache
+{
+ private:
+  image_map m_images;
+  std::list<Image *> m_lru;
+  Residency *m_residency;
+  int m_system_budget;
+  int m_system_bytes;
+  int m_hits;
+  int m_misses;
+  int m_evictions;
+
+ private:
+  void releaseSurface(Image *image);
+  void releaseData(Image *image);
+  void trim(Image *keep);
+
+ public:
+  ImageCache(Residency *residency, int systemBudget=IMAGE_CACHE_SYSTEM_BUDGET);
+  ~ImageCache();
+  Image *get(const char *path, float scale);
+  Image *hold(const char *path, float scale);
+  void touch(Image *image);
+  void update(Image *image);
+  void releaseSurfaces();
+  int systemBytes() { return m_system_bytes; }
+  int hits() { return m_hits; }
+  int misses() { return m_misses; }
+  int evictions() { return m_evictions; }
+};
+
+#endif
@@ -18,18 +18,93 @@
 */
 
 #include <stdio.h>
-#include <unistd.h>
+#include <stdlib.h>
 #include "ImageLoader.h"
 
-ImageLoader::ImageLoader() 
-  : Thread()
+ImageLoader::ImageLoader(Backend *backend, DiskCache *diskCache) 
+  : Thread(),
+    m_backend(backend),
+    m_disk_cache(diskCache)
 {
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_cond, NULL);
+}
+
+ImageLoader::~ImageLoader()
+{
+  stop();
+  for (int i=0; i < m_done.size(); i++)
+    if (m_done[i].ok) DiskCache::release(m_done[i].dsc.preallocated[0].data, m_done[i].mapped);
+  pthread_cond_destroy(&m_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void ImageLoader::stop()
+{
+  if (!m_running) return;
+  pthread_mutex_lock(&m_mutex);
+  m_running = false;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+  Thread::stop();
+}
+
+void ImageLoader::request(Image *image, const char *path, float scale, float screenScale)
+{
+  ImageRequest request;
+  request.image = image;
+  request.path = path;
+  request.scale = scale;
+  request.screen_scale = screenScale;
+  request.mapped = 0;
+  request.ok = false;
+  request.dropped = false;
+
+  pthread_mutex_lock(&m_mutex);
+  m_queue.push_back(request);
+  if (m_queue.size() > IMAGE_LOADER_QUEUE_SIZE) {
+    m_queue.front().dropped = true;
+    m_done.push_back(m_queue.front());
+    m_queue.pop_front();
+  }
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+bool ImageLoader::finished(ImageRequest *request)
+{
+  bool found = false;
+
+  pthread_mutex_lock(&m_mutex);
+  if (!m_done.empty()) {
+    *request = m_done.front();
+    m_done.pop_front();
+    found = true;
+  }
+  pthread_mutex_unlock(&m_mutex);
+  return found;
 }
 
 void ImageLoader::run()
 {
+  ImageRequest request;
+
+  pthread_mutex_lock(&m_mutex);
   while (m_running) {
-    sleep(5);
-    printf("tick\n");
+    if (m_queue.empty()) {
+      pthread_cond_wait(&m_cond, &m_mutex);
+      continue;
+    }
+    request = m_queue.back();
+    m_queue.pop_back();
+    pthread_mutex_unlock(&m_mutex);
+
+    request.ok = m_disk_cache->decodeImage(m_backend, request.path.c_str(), request.scale, request.screen_scale,
+                                           &request.dsc, &request.mapped);
+
+    pthread_mutex_lock(&m_mutex);
+    m_done.push_back(request);
+    m_backend->wakeUp();
   }
+  pthread_mutex_unlock(&m_mutex);
 }
@@ -20,15 +20,55 @@
 #ifndef IMAGELOADER_H
 #define IMAGELOADER_H
 
+#include <deque>
+#include <string>
+#include <pthread.h>
 #include "Thread.h"
+#include "Backend.h"
+#include "DiskCache.h"
+
+// Requests waiting beyond this many are dropped, oldest first.
+#define IMAGE_LOADER_QUEUE_SIZE 32
+
+struct Image;
+
+struct ImageRequest
+{
+  Image *image;
+  std::string path;
+  float scale;
+  float screen_scale;
+  DFBSurfaceDescription dsc;
+  int mapped;
+  bool ok;
+  bool dropped;
+};
+
+// Decodes images into system memory in the background.  The newest
+// request is served first, so the rows that are on screen after fast
+// scrolling win over the ones that were skipped.  The ones skipped the
+// longest are dropped once too many wait, and handed back unloaded, so
+// the queue does not grow with every row scrolled past.
 
 class ImageLoader : public Thread
 {
+ private:
+  Backend *m_backend;
+  DiskCache *m_disk_cache;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  std::deque<ImageRequest> m_queue;
+  std::deque<ImageRequest> m_done;
+
  protected:
   virtual void run();
 
  public:
-  ImageLoader();
+  ImageLoader(Backend *backend, DiskCache *diskCache);
+  virtual ~ImageLoader();
+  virtual void stop();
+  void request(Image *image, const char *path, float scale, float screenScale);
+  bool finished(ImageRequest *request);
 };
 
 #endif
@@ -0,0 +1,115 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+#include "LabelCache.h"
+#include "Font.h"
+
+LabelCache::LabelCache(Residency *residency, int budget)
+  : m_residency(residency),
+    m_budget(budget),
+    m_bytes(0),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+LabelCache::~LabelCache()
+{
+  debug("label cache: %d hits, %d misses\n", m_hits, m_misses);
+  clear();
+}
+
+void LabelCache::render(Label *label, const LabelKey &key)
+{
+  label->surface = key.font->render(key.text.c_str(), key.max_width, &label->width, &label->height, &label->ascent);
+  label->bytes = label->width * label->height;
+  if (label->surface) m_residency->add(label, label->bytes);
+}
+
+void LabelCache::release(Label *label)
+{
+  m_residency->remove(label);
+  if (label->surface) delete label->surface;
+  delete label;
+}
+
+Label *LabelCache::get(Font *font, const char *text, int maxWidth)
+{
+  LabelKey key(font, text, maxWidth);
+  label_map::iterator i = m_labels.find(key);
+  Label *label;
+
+  if (i != m_labels.end()) {
+    label = i->second;
+    m_lru.splice(m_lru.begin(), m_lru, label->cached);
+    if (label->evicted) restore(label);
+    else m_residency->touch(label);
+    m_hits++;
+    return label;
+  }
+
+  m_misses++;
+  label = new Label;
+  render(label, key);
+  m_lru.push_front(label);
+  label->cached = m_lru.begin();
+  label->entry = m_labels.insert(std::make_pair(key, label)).first;
+  m_bytes += label->bytes;
+  trim(label);
+  return label;
+}
+
+void LabelCache::trim(Label *keep)
+{
+  while (m_bytes > m_budget && m_lru.back() != keep) {
+    Label *label = m_lru.back();
+    m_lru.pop_back();
+    m_labels.erase(label->entry);
+    m_bytes -= label->bytes;
+    release(label);
+  }
+}
+
+void LabelCache::restore(Label *label)
+{
+  if (!label->evicted) return;
+  m_bytes -= label->bytes;
+  render(label, label->entry->first);
+  m_bytes += label->bytes;
+}
+
+void LabelCache::releaseSurfaces()
+{
+  for (label_map::const_iterator i=m_labels.begin(); i != m_labels.end(); i++) {
+    Label *label = i->second;
+    m_residency->remove(label);
+    label->evict();
+    label->evicted = true;
+  }
+}
+
+void LabelCache::clear()
+{
+  for (label_map::const_iterator i=m_labels.begin(); i != m_labels.end(); i++)
+    release(i->second);
+  m_labels.clear();
+  m_lru.clear();
+  m_bytes = 0;
+}
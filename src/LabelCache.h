@@ -0,0 +1,95 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LABELCACHE_H
+#define LABELCACHE_H
+
+#include <map>
+#include <list>
+#include <string>
+#include "Surface.h"
+#include "Residency.h"
+
+#define LABEL_CACHE_BUDGET (2*1024*1024)
+
+class Font;
+struct Label;
+
+struct LabelKey
+{
+  Font *font;
+  std::string text;
+  int max_width;
+
+  LabelKey(Font *f, const char *t, int w) : font(f), text(t), max_width(w) {}
+  bool operator<(const LabelKey &key) const {
+    if (font != key.font) return font < key.font;
+    if (max_width != key.max_width) return max_width < key.max_width;
+    return text < key.text;
+  }
+};
+
+typedef std::map<LabelKey, Label *> label_map;
+
+struct Label : public Resident
+{
+  Surface *surface;
+  int width;
+  int height;
+  int ascent;
+  int bytes;
+  label_map::iterator entry;
+  std::list<Label *>::iterator cached;
+
+  Label() : Resident(RESIDENT_LABEL) {}
+  virtual void evict() { delete surface; surface = NULL; }
+};
+
+// Text rendered once into A8 surfaces, which are drawn colorized with the
+// current colour.  Least recently used labels are dropped once the
+// budget is exceeded, and labels evicted from video memory are rendered
+// again when next used.
+
+class LabelCache
+{
+ private:
+  label_map m_labels;
+  std::list<Label *> m_lru;
+  Residency *m_residency;
+  int m_budget;
+  int m_bytes;
+  int m_hits;
+  int m_misses;
+
+ private:
+  void trim(Label *keep);
+  void render(Label *label, const LabelKey &key);
+  void release(Label *label);
+
+ public:
+  LabelCache(Residency *residency, int budget=LABEL_CACHE_BUDGET);
+  ~LabelCache();
+  Label *get(Font *font, const char *text, int maxWidth=0);
+  void restore(Label *label);
+  void releaseSurfaces();
+  void clear();
+  int bytes() { return m_bytes; }
+};
+
+#endif
@@ -32,23 +32,32 @@ MainMenu::MainMenu(Application *application)
   new MenuItem(this, "Exit");
 }
 
-void MainMenu::selectItem(MenuItem *menuItem)
+Screen *MainMenu::build(MenuItem *menuItem)
 {
-  debug("in MainMenu::m_cb\n");
   if (!strcmp(menuItem->label(), "Movies"))
-    m_app->go(new FileMenu(m_app, "Movies", "/share/Video/Movies"));
+    return new FileMenu(m_app, "Movies", "/share/Video/Movies");
   else if (!strcmp(menuItem->label(), "TV Shows"))
-    m_app->go(new FileMenu(m_app, "TV Shows", "/share/Video/TV Shows"));
+    return new FileMenu(m_app, "TV Shows", "/share/Video/TV Shows");
   else if (!strcmp(menuItem->label(), "Music"))
-    m_app->go(new MusicMenu(m_app));
+    return new MusicMenu(m_app);
   else if (!strcmp(menuItem->label(), "Downloads"))
-    m_app->go(new FileMenu(m_app, "Downloads", "/share/Download"));
+    return new FileMenu(m_app, "Downloads", "/share/Download");
   else if (!strcmp(menuItem->label(), "Files"))
-    m_app->go(new FileMenu(m_app, "Files", "/share"));
+    return new FileMenu(m_app, "Files", "/share");
   else if (!strcmp(menuItem->label(), "Settings"))
-    m_app->go(new SettingsMenu(m_app));
-  else if (!strcmp(menuItem->label(), "Exit"))
+    return new SettingsMenu(m_app);
+  return NULL;
+}
+
+void MainMenu::selectItem(MenuItem *menuItem)
+{
+  debug("in MainMenu::m_cb\n");
+  if (!strcmp(menuItem->label(), "Exit"))
     m_app->exit();
+  else {
+    Screen *screen = take(menuItem);
+    if (screen) m_app->go(screen);
+  }
 }
 
 void MainMenu::paint()
@@ -59,15 +68,15 @@ void MainMenu::paint()
   r->color(0,0,0,0xff);
   r->rect(150, 150,400,400);
   if (!strcmp(currentItem()->label(), "Movies"))
-    r->image(150, 150, "data/movies.png", false, 2.0);
+    r->imageAsync(150, 150, "data/movies.png", NULL, false, 2.0);
   else if (!strcmp(currentItem()->label(), "TV Shows"))
-    r->image(150, 150, "data/tvshows.png", false, 2.0);
+    r->imageAsync(150, 150, "data/tvshows.png", NULL, false, 2.0);
   else if (!strcmp(currentItem()->label(), "Music"))
-    r->image(150, 150, "data/music.png", false, 2.0);
+    r->imageAsync(150, 150, "data/music.png", NULL, false, 2.0);
   else if (!strcmp(currentItem()->label(), "Downloads"))
     ;
   else if (!strcmp(currentItem()->label(), "Files"))
     ;
   else if (!strcmp(currentItem()->label(), "Settings"))
-    r->image(150, 150, "data/settings.png", false, 2.0);
+    r->imageAsync(150, 150, "data/settings.png", NULL, false, 2.0);
 }
@@ -0,0 +1,390 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include "MemoryBackend.h"
+#include "Utils.h"
+
+// x*y/255, rounded
+#define mul255(x,y) ((((x)*(y)+128) + (((x)*(y)+128) >> 8)) >> 8)
+
+static inline void blend_argb(unsigned *dst, unsigned r, unsigned g, unsigned b, unsigned a)
+{
+  unsigned d = *dst, ia = 255 - a;
+  *dst = ((a + mul255((d >> 24), ia)) << 24) |
+    ((mul255(r, a) + mul255((d >> 16) & 0xff, ia)) << 16) |
+    ((mul255(g, a) + mul255((d >> 8) & 0xff, ia)) << 8) |
+    (mul255(b, a) + mul255(d & 0xff, ia));
+}
+
+static inline void blend_a8(unsigned char *dst, unsigned a)
+{
+  *dst = a + mul255(*dst, 255 - a);
+}
+
+MemorySurface::MemorySurface(int width, int height, DFBSurfacePixelFormat format, bool doubleBuffered)
+  : m_format(format),
+    m_width(width),
+    m_height(height),
+    m_front(NULL),
+    m_owned(true),
+    m_drawing_flags(DSDRAW_NOFX),
+    m_blitting_flags(DSBLIT_NOFX)
+{
+  m_pitch = m_format == DSPF_A8 ? m_width : m_width * 4;
+  m_data = (unsigned char *)calloc(m_height, m_pitch);
+  if (doubleBuffered) m_front = (unsigned char *)calloc(m_height, m_pitch);
+  setColor(0, 0, 0, 0);
+  setClip(NULL);
+}
+
+MemorySurface::MemorySurface(DFBSurfaceDescription *dsc)
+  : m_format(dsc->flags & DSDESC_PIXELFORMAT ? dsc->pixelformat : DSPF_ARGB),
+    m_width(dsc->width),
+    m_height(dsc->height),
+    m_front(NULL),
+    m_owned(!(dsc->flags & DSDESC_PREALLOCATED)),
+    m_drawing_flags(DSDRAW_NOFX),
+    m_blitting_flags(DSBLIT_NOFX)
+{
+  if (m_format != DSPF_A8) m_format = DSPF_ARGB;
+  if (m_owned) {
+    m_pitch = m_format == DSPF_A8 ? m_width : m_width * 4;
+    m_data = (unsigned char *)calloc(m_height, m_pitch);
+  }
+  else {
+    m_pitch = dsc->preallocated[0].pitch;
+    m_data = (unsigned char *)dsc->preallocated[0].data;
+  }
+  setColor(0, 0, 0, 0);
+  setClip(NULL);
+}
+
+MemorySurface::~MemorySurface()
+{
+  if (m_owned && m_data) free(m_data);
+  if (m_front) free(m_front);
+}
+
+void MemorySurface::getSize(int *width, int *height)
+{
+  *width = m_width;
+  *height = m_height;
+}
+
+void MemorySurface::setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+  m_color[0] = r;
+  m_color[1] = g;
+  m_color[2] = b;
+  m_color[3] = a;
+}
+
+void MemorySurface::setClip(const DFBRegion *clip)
+{
+  m_clip.x1 = clip ? maximum(clip->x1, 0) : 0;
+  m_clip.y1 = clip ? maximum(clip->y1, 0) : 0;
+  m_clip.x2 = clip ? minimum(clip->x2, m_width - 1) : m_width - 1;
+  m_clip.y2 = clip ? minimum(clip->y2, m_height - 1) : m_height - 1;
+}
+
+void MemorySurface::getClip(DFBRegion *clip)
+{
+  *clip = m_clip;
+}
+
+bool MemorySurface::clipRect(int *x, int *y, int *w, int *h)
+{
+  int x2 = minimum(*x + *w - 1, m_clip.x2);
+  int y2 = minimum(*y + *h - 1, m_clip.y2);
+  *x = maximum(*x, m_clip.x1);
+  *y = maximum(*y, m_clip.y1);
+  *w = x2 - *x + 1;
+  *h = y2 - *y + 1;
+  return m_data && *w > 0 && *h > 0;
+}
+
+void MemorySurface::plot(int x, int y)
+{
+  if (x < m_clip.x1 || x > m_clip.x2 || y < m_clip.y1 || y > m_clip.y2 || !m_data) return;
+
+  bool blend = m_drawing_flags & DSDRAW_BLEND;
+  if (m_format == DSPF_A8) {
+    unsigned char *p = m_data + y * m_pitch + x;
+    if (blend) blend_a8(p, m_color[3]);
+    else *p = m_color[3];
+  }
+  else {
+    unsigned *p = (unsigned *)(m_data + y * m_pitch) + x;
+    if (blend) blend_argb(p, m_color[0], m_color[1], m_color[2], m_color[3]);
+    else *p = (m_color[3] << 24) | (m_color[0] << 16) | (m_color[1] << 8) | m_color[2];
+  }
+}
+
+void MemorySurface::fillRectangle(int x, int y, int w, int h)
+{
+  if (!clipRect(&x, &y, &w, &h)) return;
+
+  bool blend = m_drawing_flags & DSDRAW_BLEND;
+  unsigned pixel = (m_color[3] << 24) | (m_color[0] << 16) | (m_color[1] << 8) | m_color[2];
+
+  for (int j = y; j < y + h; j++) {
+    if (m_format == DSPF_A8) {
+      unsigned char *p = m_data + j * m_pitch + x;
+      if (!blend) memset(p, m_color[3], w);
+      else for (int i = 0; i < w; i++) blend_a8(p + i, m_color[3]);
+    }
+    else {
+      unsigned *p = (unsigned *)(m_data + j * m_pitch) + x;
+      if (!blend) for (int i = 0; i < w; i++) p[i] = pixel;
+      else for (int i = 0; i < w; i++) blend_argb(p + i, m_color[0], m_color[1], m_color[2], m_color[3]);
+    }
+  }
+}
+
+void MemorySurface::drawLine(int x1, int y1, int x2, int y2)
+{
+  int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+  int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+  int err = dx + dy;
+
+  while (true) {
+    plot(x1, y1);
+    if (x1 == x2 && y1 == y2) break;
+    int e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x1 += sx; }
+    if (e2 <= dx) { err += dx; y1 += sy; }
+  }
+}
+
+void MemorySurface::blit(Surface *source, const DFBRectangle *rect, int x, int y)
+{
+  MemorySurface *src = (MemorySurface *)source;
+  DFBRectangle r = { 0, 0, src->m_width, src->m_height };
+  if (rect) r = *rect;
+
+  int dx = x, dy = y, w = r.w, h = r.h;
+  if (!src->m_data || !clipRect(&dx, &dy, &w, &h)) return;
+  r.x += dx - x;
+  r.y += dy - y;
+
+  bool blend = m_blitting_flags & DSBLIT_BLEND_ALPHACHANNEL;
+  bool colorize = m_blitting_flags & DSBLIT_COLORIZE;
+
+  for (int j = 0; j < h; j++) {
+    unsigned char *s = src->m_data + (r.y + j) * src->m_pitch;
+    unsigned char *d = m_data + (dy + j) * m_pitch;
+    if (src->m_format == m_format && !blend && !colorize) {
+      int bpp = m_format == DSPF_A8 ? 1 : 4;
+      memcpy(d + dx * bpp, s + r.x * bpp, w * bpp);
+      continue;
+    }
+    for (int i = 0; i < w; i++) {
+      unsigned sr, sg, sb, sa;
+      if (src->m_format == DSPF_A8) {
+        sa = s[r.x + i];
+        sr = sg = sb = 0xff;
+      }
+      else {
+        unsigned p = ((unsigned *)s)[r.x + i];
+        sa = p >> 24; sr = (p >> 16) & 0xff; sg = (p >> 8) & 0xff; sb = p & 0xff;
+      }
+      if (colorize) {
+        sr = mul255(sr, m_color[0]);
+        sg = mul255(sg, m_color[1]);
+        sb = mul255(sb, m_color[2]);
+      }
+      if (m_format == DSPF_A8) {
+        if (blend) blend_a8(d + dx + i, sa);
+        else d[dx + i] = sa;
+      }
+      else {
+        unsigned *p = (unsigned *)d + dx + i;
+        if (blend) blend_argb(p, sr, sg, sb, sa);
+        else *p = (sa << 24) | (sr << 16) | (sg << 8) | sb;
+      }
+    }
+  }
+}
+
+void MemorySurface::batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num)
+{
+  for (int i=0; i < num; i++)
+    blit(source, &rects[i], points[i].x, points[i].y);
+}
+
+void MemorySurface::flip(const DFBRegion *region, DFBSurfaceFlipFlags flags)
+{
+  if (!m_front) return;
+
+  if (!region && !(flags & DSFLIP_BLIT)) {
+    unsigned char *front = m_front;
+    m_front = m_data;
+    m_data = front;
+    return;
+  }
+
+  DFBRegion r = { 0, 0, m_width - 1, m_height - 1 };
+  if (region) r = *region;
+  int bpp = m_format == DSPF_A8 ? 1 : 4;
+  int x1 = maximum(r.x1, 0), x2 = minimum(r.x2, m_width - 1);
+  for (int y = maximum(r.y1, 0); y <= minimum(r.y2, m_height - 1) && x2 >= x1; y++)
+    memcpy(m_front + y * m_pitch + x1 * bpp, m_data + y * m_pitch + x1 * bpp, (x2 - x1 + 1) * bpp);
+}
+
+bool MemorySurface::lock(void **data, int *pitch)
+{
+  *data = m_data;
+  *pitch = m_pitch;
+  return m_data != NULL;
+}
+
+MemoryBackend::MemoryBackend(int width, int height)
+  : m_width(width),
+    m_height(height),
+    m_primary(NULL)
+{
+  if (pipe(m_wakeup) == 0) {
+    fcntl(m_wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_wakeup[1], F_SETFL, O_NONBLOCK);
+  }
+  else {
+    fprintf(stderr, "Unable to create wakeup pipe\n");
+    m_wakeup[0] = m_wakeup[1] = -1;
+  }
+}
+
+MemoryBackend::~MemoryBackend()
+{
+  close();
+  if (m_wakeup[0] >= 0) ::close(m_wakeup[0]);
+  if (m_wakeup[1] >= 0) ::close(m_wakeup[1]);
+}
+
+bool MemoryBackend::open()
+{
+  if (!m_primary) m_primary = new MemorySurface(m_width, m_height, DSPF_ARGB, true);
+  return true;
+}
+
+void MemoryBackend::close()
+{
+  if (m_primary) delete m_primary;
+  m_primary = NULL;
+}
+
+Surface *MemoryBackend::createSurface(DFBSurfaceDescription *dsc)
+{
+  return new MemorySurface(dsc);
+}
+
+static unsigned be16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+static unsigned be32(const unsigned char *p) { return (be16(p) << 16) | be16(p + 2); }
+
+// Only the image dimensions are read, so the headless build needs no
+// image libraries.
+static bool imageSize(const char *path, int *width, int *height)
+{
+  unsigned char buf[24];
+  FILE *f = fopen(path, "rb");
+  bool ok = false;
+
+  if (!f) return false;
+  if (fread(buf, 1, 24, f) == 24) {
+    if (!memcmp(buf, "\x89PNG", 4) && !memcmp(buf + 12, "IHDR", 4)) {
+      *width = be32(buf + 16);
+      *height = be32(buf + 20);
+      ok = true;
+    }
+    else if (buf[0] == 0xff && buf[1] == 0xd8) {
+      long pos = 2;
+      while (!ok && !fseek(f, pos, SEEK_SET) && fread(buf, 1, 9, f) == 9 && buf[0] == 0xff) {
+        if (buf[1] >= 0xc0 && buf[1] <= 0xcf && buf[1] != 0xc4 && buf[1] != 0xc8 && buf[1] != 0xcc) {
+          *height = be16(buf + 5);
+          *width = be16(buf + 7);
+          ok = true;
+        }
+        pos += 2 + be16(buf + 2);
+      }
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+bool MemoryBackend::decodeImage(const char *path, float scale, DFBSurfaceDescription *dsc)
+{
+  int width, height;
+
+  dsc->preallocated[0].data = NULL;
+  if (!imageSize(path, &width, &height)) {
+    debug("unknown image format: %s\n", path);
+    return false;
+  }
+
+  dsc->flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED);
+  dsc->caps = DSCAPS_SYSTEMONLY;
+  dsc->width = (int)(width * scale);
+  dsc->height = (int)(height * scale);
+  dsc->pixelformat = DSPF_ARGB;
+  dsc->preallocated[0].pitch = dsc->width * 4;
+  dsc->preallocated[1].data = NULL;
+  dsc->preallocated[1].pitch = 0;
+  if (dsc->width <= 0 || dsc->height <= 0 ||
+      !(dsc->preallocated[0].data = malloc(dsc->height * dsc->preallocated[0].pitch)))
+    return false;
+
+  unsigned *p = (unsigned *)dsc->preallocated[0].data;
+  for (int i = 0; i < dsc->width * dsc->height; i++) p[i] = 0xff808080;
+  return true;
+}
+
+void MemoryBackend::waitForEvent(int timeout)
+{
+  fd_set fds;
+  struct timeval tv;
+  char buf[64];
+
+  if (m_wakeup[0] < 0) {
+    usleep(timeout < 0 ? 100000 : timeout * 1000);
+    return;
+  }
+  FD_ZERO(&fds);
+  FD_SET(m_wakeup[0], &fds);
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+  if (select(m_wakeup[0] + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv) > 0) {
+    while (read(m_wakeup[0], buf, sizeof(buf)) > 0);
+  }
+}
+
+void MemoryBackend::wakeUp()
+{
+  if (m_wakeup[1] >= 0) write(m_wakeup[1], "", 1);
+}
+
+bool MemoryBackend::getEvent(Event *event)
+{
+  return false;
+}
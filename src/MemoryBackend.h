@@ -0,0 +1,93 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORYBACKEND_H
+#define MEMORYBACKEND_H
+
+#include "Backend.h"
+
+#define MEMORY_WIDTH 1280
+#define MEMORY_HEIGHT 720
+
+// Software ARGB/A8 surface.  Good enough to run and time the paint path
+// on a host without DirectFB; not meant to be pixel exact.
+
+class MemorySurface : public Surface
+{
+ private:
+  DFBSurfacePixelFormat m_format;
+  int m_width;
+  int m_height;
+  int m_pitch;
+  unsigned char *m_data;
+  unsigned char *m_front;
+  bool m_owned;
+  DFBRegion m_clip;
+  unsigned char m_color[4];
+  DFBSurfaceDrawingFlags m_drawing_flags;
+  DFBSurfaceBlittingFlags m_blitting_flags;
+
+ private:
+  void plot(int x, int y);
+  bool clipRect(int *x, int *y, int *w, int *h);
+
+ public:
+  MemorySurface(int width, int height, DFBSurfacePixelFormat format, bool doubleBuffered=false);
+  MemorySurface(DFBSurfaceDescription *dsc);
+  virtual ~MemorySurface();
+  unsigned char *front() { return m_front ? m_front : m_data; }
+  virtual void getSize(int *width, int *height);
+  virtual DFBSurfacePixelFormat pixelFormat() { return m_format; }
+  virtual void setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+  virtual void setClip(const DFBRegion *clip);
+  virtual void getClip(DFBRegion *clip);
+  virtual void setDrawingFlags(DFBSurfaceDrawingFlags flags) { m_drawing_flags = flags; }
+  virtual void setBlittingFlags(DFBSurfaceBlittingFlags flags) { m_blitting_flags = flags; }
+  virtual void fillRectangle(int x, int y, int w, int h);
+  virtual void drawLine(int x1, int y1, int x2, int y2);
+  virtual void blit(Surface *source, const DFBRectangle *rect, int x, int y);
+  virtual void batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num);
+  virtual void flip(const DFBRegion *region, DFBSurfaceFlipFlags flags);
+  virtual bool lock(void **data, int *pitch);
+  virtual void unlock() {};
+};
+
+class MemoryBackend : public Backend
+{
+ private:
+  int m_width;
+  int m_height;
+  MemorySurface *m_primary;
+  int m_wakeup[2];
+
+ public:
+  MemoryBackend(int width=MEMORY_WIDTH, int height=MEMORY_HEIGHT);
+  virtual ~MemoryBackend();
+  virtual bool open();
+  virtual void close();
+  virtual Surface *primary() { return m_primary; }
+  virtual Surface *createSurface(DFBSurfaceDescription *dsc);
+  virtual bool decodeImage(const char *path, float scale, DFBSurfaceDescription *dsc);
+  virtual bool decodesPixels() { return false; }
+  virtual void waitForEvent(int timeout);
+  virtual void wakeUp();
+  virtual bool getEvent(Event *event);
+};
+
+#endif
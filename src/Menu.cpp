@@ -23,32 +23,135 @@
 
 Menu::Menu(Application *application, const char *title)
   : Screen(application),
+    m_source(NULL),
+    m_adding(-1),
     m_size(0),
     m_current(-1),
     m_top(160),
-    m_idle_count(0)
+    m_details_timer(0),
+    m_marquee_timer(0),
+    m_jump(-1),
+    m_jump_timer(0),
+    m_prebuilt(NULL),
+    m_prebuilt_index(-1),
+    m_loading(false)
 {  
+  Renderer *r = m_app->renderer();
+
   setLabel(title);
+  m_title.font = NULL;
+  m_title_font = r->fontHandle(BOLD_FONT, 37);
+  m_bg = r->imageHandle("data/menuitem_bg.png");
+  m_fade_top = r->imageHandle("data/fade_top.png");
+  m_fade_bot = r->imageHandle("data/fade_bot.png");
+  m_jump_font = r->fontHandle(BOLD_FONT, 72);
+  m_loading_font = r->fontHandle(REGULAR_FONT, 23);
+  m_details_timer = r->scheduler()->schedule(this, MENU_DETAILS_DELAY);
 }
 
 Menu::~Menu()
 {
-  for (int i; i<m_size; i++) {
+  delete m_prebuilt;
+  for (int i=0; i<m_menuItems.size(); i++) {
     delete m_menuItems[i];
   }
+  for (std::map<int, MenuItem *>::const_iterator i=m_rows.begin(); i != m_rows.end(); i++) {
+    delete i->second;
+  }
 }
 
 void Menu::add(MenuItem *menuItem)
 {
-  if (m_size < MAX_MENU_ITEMS) {
-    menuItem->setIndex(m_size);
-    m_menuItems[m_size++] = menuItem;
+  if (m_source) {
+    // a row being materialized by item()
+    menuItem->setIndex(m_adding);
+    m_rows[m_adding] = menuItem;
+    return;
   }
+  menuItem->setIndex(m_size++);
+  m_menuItems.push_back(menuItem);
   if (m_size == 1) m_current = 0;
 }
 
+// Switches the menu to the rows of source, which the menu does not own.
+// Setting it again starts over from the rows the source has now.
+void Menu::setSource(MenuSource *source)
+{
+  for (std::map<int, MenuItem *>::const_iterator i=m_rows.begin(); i != m_rows.end(); i++) {
+    delete i->second;
+  }
+  m_rows.clear();
+  m_source = source;
+  m_size = source->count();
+  m_current = m_size ? 0 : -1;
+  fill(MENU_FETCH_AHEAD);
+}
+
+MenuItem *Menu::item(int index)
+{
+  if (!m_source) return m_menuItems[index];
+
+  std::map<int, MenuItem *>::iterator i = m_rows.find(index);
+  if (i != m_rows.end()) return i->second;
+
+  m_adding = index;
+  m_source->row(this, index);
+  m_adding = -1;
+  return m_rows[index];
+}
+
+// Fetches rows from the source until it has at least rows of them.
+void Menu::fill(int rows)
+{
+  while (m_size < rows && m_source->fetch(rows))
+    m_size = m_source->count();
+  if (m_current < 0 && m_size) m_current = 0;
+}
+
+// Moves the selection to the first row of the next (direction 1) or
+// previous (-1) letter in m_jumps, and shows that letter over the list.
+bool Menu::jump(int direction)
+{
+  int i = m_jumps.size() - 1;
+
+  // the letter of the current row; going back from within a letter
+  // first returns to its start
+  while (i >= 0 && m_jumps[i].row > m_current) i--;
+  if (direction > 0) i++;
+  else if (i >= 0 && m_jumps[i].row == m_current) i--;
+  if (i < 0 || i >= m_jumps.size()) return false;
+
+  if (m_source) fill(m_jumps[i].row + 1 + MENU_FETCH_AHEAD);
+  if (m_jumps[i].row >= m_size) return false;
+  m_current = m_jumps[i].row;
+  m_jump = i;
+
+  Scheduler *scheduler = m_app->renderer()->scheduler();
+  scheduler->cancel(m_jump_timer);
+  m_jump_timer = scheduler->schedule(this, MENU_JUMP_OVERLAY_TIME);
+  return true;
+}
+
+// Drops the items of rows that scrolled out of view.
+void Menu::releaseRows()
+{
+  int start, end;
+
+  if (!m_source) return;
+  getVisibleRange(&start, &end);
+  std::map<int, MenuItem *>::iterator i = m_rows.begin();
+  while (i != m_rows.end()) {
+    if (i->first < start || i->first > end) {
+      delete i->second;
+      m_rows.erase(i++);
+    }
+    else i++;
+  }
+}
+
 bool Menu::handleEvent(Event &event)
 {
+  if (m_source) fill(m_current + 1 + MENU_FETCH_AHEAD);
   if (m_current > -1) {
     Audio *audio = m_app->audio();
     switch (event.key) {
@@ -86,18 +189,34 @@ bool Menu::handleEvent(Event &event)
       else
         audio->playSound("data/move.pcm"); 
       break;
+    case KEY_LEFT:
+    case KEY_RIGHT:
+      if (m_jumps.empty()) index();
+      if (m_jumps.empty()) break;
+      if (jump(event.key == KEY_RIGHT ? 1 : -1))
+        audio->playSound("data/move.pcm"); 
+      else
+        audio->playSound("data/end.pcm"); 
+      break;
     case KEY_ENTER: 
       if (m_current > -1) {
         audio->playSound("data/select.pcm"); 
-        m_menuItems[m_current]->select(); 
+        item(m_current)->select(); 
       }
       break;
     }
-    debug("current item: %s\n", m_menuItems[m_current]->label());
+    releaseRows();
+    debug("current item: %s\n", item(m_current)->label());
   }
   clearDirty();
   setDirtyRegion(Box(MENU_X, m_top, 445, m_box.h - m_top));
-  m_idle_count=0;
+
+  // Details and marquee wait until the selection has settled.
+  Scheduler *scheduler = m_app->renderer()->scheduler();
+  scheduler->cancel(m_details_timer);
+  scheduler->cancel(m_marquee_timer);
+  m_marquee_timer = 0;
+  m_details_timer = scheduler->schedule(this, MENU_DETAILS_DELAY);
   debug("done handleEvent\n");
   return true;
 }
@@ -105,27 +224,70 @@ bool Menu::handleEvent(Event &event)
 bool Menu::handleIdle()
 {
   int start, end;
-  bool dirty = false;
+  bool changed = dirty();
 
-  m_idle_count++;
-  if (m_idle_count < 8) return false;
-  if (m_idle_count == 8) {
-    debug("handleIdle\n");
-    setDirtyRegion(Box(0, 0, MENU_X - 60, m_box.h));    
-    paint();
-    m_app->renderer()->flip();
+  getVisibleRange(&start, &end);        
+    
+  for (int i=start; i<=end; i++) {
+    if (item(i)->dirty()) changed = true;
+  }
+
+  return changed;
+}
+
+void Menu::handleTimer(int timer)
+{
+  if (timer == m_jump_timer) {
+    m_jump_timer = 0;
+    m_jump = -1;
+    setDirtyRegion(Box(MENU_X, m_top, 445, m_box.h - m_top));
+  }
+  if (timer == m_details_timer) {
+    debug("details timer\n");
+    m_details_timer = 0;
     setDirtyRegion(Box(0, 0, MENU_X - 60, m_box.h));    
-    dirty = true;
+    if (m_current > -1 && item(m_current)->scrolls())
+      m_marquee_timer = m_app->renderer()->scheduler()->schedule(this, SCROLL_PERIOD, SCROLL_PERIOD);
+    prebuild();
+  }
+  updateItems();
+}
+
+// Builds the screen behind the selection once it has settled, so that
+// its rows load in the background while the user decides and KEY_ENTER
+// only has to show it.  Only the menu on screen does this, not the ones
+// it prebuilt.
+void Menu::prebuild()
+{
+  if (m_current < 0 || m_app->top() != this) return;
+  if (m_prebuilt && m_prebuilt_index == m_current) return;
+  delete m_prebuilt;
+  m_prebuilt = build(item(m_current));
+  m_prebuilt_index = m_current;
+}
+
+// The screen behind menuItem, prebuilt or built now.  Building only
+// queues the loading of its rows, so a screen built now shows that it is
+// loading instead of holding up the key press.
+Screen *Menu::take(MenuItem *menuItem)
+{
+  Screen *screen = m_prebuilt;
+
+  if (screen && m_prebuilt_index == menuItem->index()) {
+    m_prebuilt = NULL;
+    return screen;
   }
+  return build(menuItem);
+}
+
+void Menu::updateItems()
+{
+  int start, end;
 
   getVisibleRange(&start, &end);        
-    
   for (int i=start; i<=end; i++) {
-    m_menuItems[i]->update();
-    if (m_menuItems[i]->dirty()) dirty = true;
+    item(i)->update();
   }
-
-  return dirty;
 }
 
 bool Menu::paintDetails(MenuItem *menuItem)
@@ -156,12 +318,12 @@ void Menu::getVisibleRange(int *start, int *end)
 void Menu::paintBackground(int start, int end, int index, bool eraseOld)
 {
   if (index >= start && index <= end) {
-    int x = MENU_X - 32, height = m_menuItems[0]->box().h;
+    int x = MENU_X - 32, height = item(start)->box().h;
     int y = m_top + (index - start) * height - 18;
     Renderer *r = m_app->renderer();
 
     if (index == m_current) {
-      r->image(x, y, "data/menuitem_bg.png");  
+      r->image(x, y, m_bg);
     }
     else if (eraseOld) {
       r->color(0, 0, 0, 0xff);
@@ -176,51 +338,53 @@ void Menu::paint()
 
   Renderer *r = m_app->renderer();
   int buffer = r->activeBuffer();
-  Box dirtyBox = getDirtyRegion(buffer);
+  Region dirty = getDirtyRegion(buffer);
 
   int x = MENU_X;
 
-  if (dirtyBox & Box(0, 0, x-60, m_box.h)) {
+  if (dirty & Box(0, 0, x-60, m_box.h)) {
     r->color(0, 0, 0, 0xff);
     r->rect(0, 0, x - 60, m_box.h);      
     if (m_current > -1)
-      paintDetails(m_menuItems[m_current]);
+      paintDetails(item(m_current));
   }
 
-  if (dirtyBox & Box(x, 0, 445, m_top)) {
+  if (dirty & Box(x, 0, 445, m_top)) {
     r->color(0, 0, 0, 0xff);
     r->rect(x-60, 0, 445+120, m_top);  
-    r->font(BOLD_FONT, 37);
+    r->font(m_title_font);
     r->color(0xff, 0xff, 0xff, 0xff);
-    r->text(x + 222, m_top - 40, m_label, 445, JUSTIFY_CENTER);
+    if (!m_title.font) r->layout(m_label, 445, &m_title);
+    r->text(x + 222, m_top - 40, m_title, JUSTIFY_CENTER);
   }
 
   if (m_current > -1) {
-    int start, end, y, height = m_menuItems[0]->box().h;
+    int start, end, y, height;
 
     getVisibleRange(&start, &end);        
+    height = item(start)->box().h;
 
-    if (dirtyBox & Box(x-60, m_top, 445+120, m_box.h - m_top)) {
+    if (dirty & Box(x-60, m_top, 445+120, m_box.h - m_top)) {
       r->color(0, 0, 0, 0xff);
       r->rect(x-60, m_top, 445+120, m_box.h - m_top);
       paintBackground(start, end, m_current, false);
 
       for (int i=start; i<=end; i++) {
-        MenuItem *mi = m_menuItems[i];
+        MenuItem *mi = item(i);
 
         y = (i - start) * height;
         mi->move(x, m_top + y);
         mi->paint();      
         if (i-start == 0 && start > 0)
-          r->image(x - 32, m_top - 18, "data/fade_top.png", true);  
+          r->image(x - 32, m_top - 18, m_fade_top, true);
         if (i-start == 9)
-          r->image(x - 32, m_top + y - 18, "data/fade_bot.png", true);  
+          r->image(x - 32, m_top + y - 18, m_fade_bot, true);
       }
     }
     else {
       bool paintCurrent = false;
       for (int i=start; i<=end; i++) {
-        MenuItem *mi = m_menuItems[i];
+        MenuItem *mi = item(i);
 
         if (mi->dirty(buffer)) {
           paintBackground(start, end, i, true);
@@ -234,16 +398,37 @@ void Menu::paint()
       if (paintCurrent) {
         paintBackground(start, end, m_current, true);      
         for (int i=m_current-1; i <= m_current+1; i++)
-          if (i >= 0 && i < m_size) m_menuItems[i]->paint();
+          if (i >= 0 && i < m_size) item(i)->paint();
       }
     }
   }
   else {
-    if (dirtyBox & Box(x-60, m_top, 445+120, m_box.h - m_top)) {
+    if (dirty & Box(x-60, m_top, 445+120, m_box.h - m_top)) {
       r->color(0, 0, 0, 0xff);
       r->rect(x-60, m_top, 445+120, m_box.h - m_top);  
+      if (m_loading) {
+        r->font(m_loading_font);
+        r->color(0x99, 0x99, 0x99, 0xff);
+        r->text(x + 222, m_top + 40, "Loading...", 445, JUSTIFY_CENTER);
+      }
     }
   }
 
+  if (m_jump > -1) paintJump();
   clearDirty(buffer);
 }
+
+// The letter last jumped to, centered over the list.  Painted on every
+// frame while shown since rows repainted under it would cover it.
+void Menu::paintJump()
+{
+  Renderer *r = m_app->renderer();
+  int size = MENU_JUMP_OVERLAY_SIZE;
+  int x = MENU_X + 222 - size / 2, y = m_top + (m_box.h - m_top - size) / 2;
+
+  r->color(0x40, 0x40, 0x40, 0xff);
+  r->rect(x, y, size, size);
+  r->font(m_jump_font);
+  r->color(0xff, 0xff, 0xff, 0xff);
+  r->text(x + size / 2, y + size * 3 / 4, m_jumps[m_jump].letter.c_str(), size, JUSTIFY_CENTER);
+}
@@ -21,40 +21,105 @@
 #define MENU_H
 
 #include <vector>
+#include <map>
+#include <string>
 #include "Screen.h"
 #include "Application.h"
+#include "Font.h"
 
-#define MAX_MENU_ITEMS 1000
 #define MENU_X 675
+#define MENU_DETAILS_DELAY 800
+// Rows kept loaded past the selection in menus whose source fetches
+// rows in pages.
+#define MENU_FETCH_AHEAD 20
+// How long the letter jumped to stays over the list.
+#define MENU_JUMP_OVERLAY_TIME 1000
+#define MENU_JUMP_OVERLAY_SIZE 120
 
 class Menu;
 class MenuItem;
 
 typedef void (*MenuItemCallback)(Menu *menu, MenuItem *menuItem);
 
+// Rows of a virtual menu.  Only the rows on screen exist as items; row()
+// creates the item for a row, which adds itself to the menu as usual.
+// Sources that load rows incrementally return true from fetch() while
+// it added rows; rows is how many the menu wants loaded in total.
+class MenuSource
+{
+ public:
+  virtual ~MenuSource() {};
+  virtual int count() = 0;
+  virtual MenuItem *row(Menu *menu, int index) = 0;
+  virtual bool fetch(int rows) { return false; }
+};
+
+// First row of the rows starting with letter, for jumping with
+// KEY_LEFT and KEY_RIGHT through a sorted menu.
+struct MenuJump
+{
+  std::string letter;
+  int row;
+};
+
 class Menu : public Screen
 {
  protected:
-  MenuItem *m_menuItems[MAX_MENU_ITEMS];
+  std::vector<MenuItem *> m_menuItems;
+  MenuSource *m_source;
+  std::map<int, MenuItem *> m_rows;
+  int m_adding;
   int m_size;
   int m_current;
   int m_top;
-  int m_idle_count;
+  int m_details_timer;
+  int m_marquee_timer;
+  TextLayout m_title;
+  FontHandle m_title_font;
+  ImageHandle m_bg;
+  ImageHandle m_fade_top;
+  ImageHandle m_fade_bot;
+  std::vector<MenuJump> m_jumps;
+  int m_jump;
+  int m_jump_timer;
+  FontHandle m_jump_font;
+  Screen *m_prebuilt;
+  int m_prebuilt_index;
+  // Set while the rows are loaded in the background, which shows the
+  // menu as loading until they arrive.
+  bool m_loading;
+  FontHandle m_loading_font;
 
  private:
   void getVisibleRange(int *start, int *end);
+  void releaseRows();
+  void fill(int rows);
+  bool jump(int direction);
+  void paintJump();
+  void prebuild();
+
+ protected:
+  Screen *take(MenuItem *menuItem);
+  // Fills m_jumps when they are first needed.
+  virtual void index() {}
+  void updateItems();
   void paintBackground(int start, int end, int index, bool eraseOld=false);
 
  public:
   Menu(Application *application, const char *title=APP_NAME);
   virtual ~Menu();
   int current() { return m_current; }
-  MenuItem *currentItem() { return m_current > -1 ? m_menuItems[m_current] : NULL; }
+  int size() { return m_size; }
+  MenuItem *item(int index);
+  MenuItem *currentItem() { return m_current > -1 ? item(m_current) : NULL; }
   void add(MenuItem *menuItem);
+  void setSource(MenuSource *source);
   virtual void selectItem(MenuItem *menuItem);
+  virtual Screen *build(MenuItem *menuItem) { return NULL; }
   virtual void focusItem(MenuItem *menuItem);
   virtual bool handleEvent(Event &event);  
   virtual bool handleIdle();  
+  virtual void handleTimer(int timer);
   virtual bool paintDetails(MenuItem *menuItem);
   virtual void paint();
 };
@@ -66,24 +131,35 @@ class MainMenu : public Menu
  public:
   MainMenu(Application *application);
   virtual void selectItem(MenuItem *menuItem);
+  virtual Screen *build(MenuItem *menuItem);
   virtual void paint();
 };
 
-class FileMenu : public Menu
+// Lists the directory at path on the loader thread.
+class FileMenu : public Menu, public MenuSource
 {
  private:
   std::vector<class File> m_files;
+  int m_load;
 
  public:
   FileMenu(Application *application, const char *title="Media", const char *path=NULL);
+  virtual ~FileMenu();
   virtual void selectItem(MenuItem *menuItem);
+  virtual bool handleIdle();
+  virtual int count();
+  virtual MenuItem *row(Menu *menu, int index);
 };
 
 class MusicMenu : public Menu
 {
+ private:
+  ImageHandle m_art;
+
  public:
   MusicMenu(Application *application);
   virtual void selectItem(MenuItem *menuItem);
+  virtual Screen *build(MenuItem *menuItem);
   virtual bool paintDetails(MenuItem *menuItem);
 };
 
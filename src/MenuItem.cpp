@@ -29,9 +29,13 @@ MenuItem::MenuItem(Menu *menu, const char *label, const void *data)
     m_menu(menu),
     m_data(data)
 {
+  Renderer *r = m_app->renderer();
+
   setLabel(label);
-  m_image_on[0] = m_image_off[0] = 0;
-  m_label_width = m_app->renderer()->textWidth(label);
+  m_font = r->fontHandle(BOLD_FONT, 29);
+  m_fade = r->imageHandle("data/menuitem_bg_fade.png");
+  m_image_on = m_image_off = NULL;
+  m_label_width = r->textWidth(label);
   m_scroll = m_label_width > MENUITEM_WIDTH;
   resize(465, 50);
   m_menu->add(this);
@@ -50,13 +54,15 @@ void MenuItem::select()
 
 void MenuItem::setImage(const char *image_on, const char *image_off)
 {
-  safe_strcpy(m_image_on, image_on);
+  Renderer *r = m_app->renderer();
+
+  m_image_on = r->imageHandle(image_on);
   
   if (image_off[0]) {
-    safe_strcpy(m_image_off, image_off);
+    m_image_off = r->imageHandle(image_off);
   }
   else {
-    safe_strcpy(m_image_off, m_image_on);
+    m_image_off = m_image_on;
   }
 }
 
@@ -82,34 +88,28 @@ void MenuItem::paint()
   Renderer *r = m_app->renderer();
   int buffer = r->activeBuffer();
 
-  r->font(BOLD_FONT, 29);
+  r->font(m_font);
   r->color(0xff, 0xff, 0xff, 0xff);
   if (!hasFocus() || !m_scroll)
-    r->text(m_screen_x, m_screen_y + 35, m_label, MENUITEM_WIDTH);
+    r->label(m_screen_x, m_screen_y + 35, m_label, MENUITEM_WIDTH);
 
   if (hasFocus()) {
     if (m_scroll) {
-      IDirectFBSurface *primary = r->surface();
-      Box clip, textclip(m_screen_x, m_screen_y-5, MENUITEM_WIDTH, 50);
       int offset = 0;
-      r->getClip(&clip);
-      r->setClip(&textclip);
       if (m_offset > SCROLL_SPEED * SCROLL_DELAY) 
         offset = m_offset - SCROLL_SPEED * SCROLL_DELAY;
-      r->text(m_screen_x-offset, m_screen_y + 35, m_label, MENUITEM_WIDTH+offset, JUSTIFY_LEFT, true);
-      r->text(m_screen_x-offset+m_label_width+60, m_screen_y + 35, m_label, MENUITEM_WIDTH+offset, JUSTIFY_LEFT, true);
-      r->setClip(&clip);
+      r->marquee(m_screen_x, m_screen_y + 35, m_label, MENUITEM_WIDTH, offset, 60);
       if (offset > 0 && offset < m_label_width+30)
-        r->image(m_screen_x-32, m_screen_y-18, "data/menuitem_bg_fade.png", true);
+        r->image(m_screen_x-32, m_screen_y-18, m_fade, true);
       else
-        r->image(m_screen_x-32, m_screen_y-18, "data/menuitem_bg_fade.png", true);
+        r->image(m_screen_x-32, m_screen_y-18, m_fade, true);
     }
   }
 
-  if (m_image_on[0] && m_image_off[0])
-    m_app->renderer()->image(m_screen_x + m_box.w - 50, m_screen_y, 
-                             hasFocus() ? m_image_on : m_image_off,
-                             true);
+  if (m_image_on && m_image_off)
+    r->image(m_screen_x + m_box.w - 50, m_screen_y, 
+             hasFocus() ? m_image_on : m_image_off,
+             true);
 
   clearDirty(buffer);
 }
@@ -131,9 +131,7 @@ void FileItem::select()
   }
   else {
     if (m_file->isVideo()) {
-      if (!app->audio()->isStopped()) app->audio()->close();
-      debug("playing %s\n", m_file->path());
-      app->renderer()->play(m_file->path());
+      app->play(m_file->path());
     }
     else if (m_file->isAudio()) {
       if (strcmp(app->audio()->nowPlaying(), m_file->path())) {
@@ -157,6 +155,7 @@ ArrowItem::ArrowItem(Menu *menu, const char *label, const void *data)
 InfoItem::InfoItem(Menu *menu, const char *label, const char *info)
   : MenuItem(menu, label)
 {
+  m_info_font = m_app->renderer()->fontHandle(REGULAR_FONT, 23);
   setInfo(info);
 }
 
@@ -176,12 +175,12 @@ void InfoItem::paint()
 
   MenuItem::paint();
 
-  r->font(REGULAR_FONT, 23);
+  r->font(m_info_font);
   if (hasFocus())
     r->color(0xff, 0xff, 0xff, 0xff);
   else
     r->color(0x99, 0x99, 0x99, 0xff);
-  r->text(m_screen_x + MENUITEM_WIDTH, m_screen_y + 35, m_info, 200, JUSTIFY_RIGHT);
+  r->label(m_screen_x + MENUITEM_WIDTH, m_screen_y + 35, m_info, 200, JUSTIFY_RIGHT);
   
   clearDirty(buffer);
 }
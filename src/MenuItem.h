@@ -26,14 +26,17 @@
 #define MENUITEM_WIDTH 435
 #define SCROLL_SPEED 8
 #define SCROLL_DELAY 8
+#define SCROLL_PERIOD 100
 
 class MenuItem : public Widget
 {
  protected:
   const void *m_data;
   int m_index;
-  char m_image_on[256];
-  char m_image_off[256];
+  FontHandle m_font;
+  ImageHandle m_fade;
+  ImageHandle m_image_on;
+  ImageHandle m_image_off;
   int m_x;
   int m_y;
   int m_offset;
@@ -50,6 +53,7 @@ class MenuItem : public Widget
   virtual void select();
   void setIndex(int i) { m_index = i; }
   int index() { return m_index; }
+  bool scrolls() { return m_scroll; }
   void setImage(const char *image_on, const char *image_off="");
   virtual void update();
   virtual void paint();
@@ -75,6 +79,7 @@ class InfoItem : public MenuItem
 {
  private:
   char m_info[256];
+  FontHandle m_info_font;
  public:
   InfoItem(Menu *menu, const char *label, const char *info="");  
   void setInfo(const char *info, const char *label=NULL);
@@ -28,9 +28,7 @@ MoviesMenu::MoviesMenu(Application *application, const char *title, const char *
 
 void MoviesMenu::selectFile(File &file)
 {
-  if (!m_app->audio()->isStopped()) m_app->audio()->close();
-  debug("playing %s\n", file.path());
-  m_app->renderer()->play(file.path());
+  m_app->play(file.path());
 }
 
 void MoviesMenu::selectDirectory(File &file)
@@ -21,6 +21,12 @@
 #include "Menu.h"
 #include "Player.h"
 #include "Utils.h"
+#include "Searcher.h"
+#include "Pager.h"
+
+#define MUSIC_PAGE_SIZE 50
+// Typing pauses this long before the search starts.
+#define SEARCH_DELAY 300
 
 class Song
 {
@@ -106,42 +112,231 @@ public:
   }
 };
 
-class SongsMenu : public Menu
+// A menu of the rows of a query in case insensitive order of a key
+// column, fetched a page at a time by a Pager.  The first page is loaded
+// in the background while the menu shows that it is loading.  After it,
+// the first row of each leading character of the key is counted in the
+// background too, so jumps to a letter know their row without loading it.
+class PagedMenu : public Menu, public MenuSource
 {
 private:
+  Pager *m_pager;
+  int m_load;
+  int m_index_load;
+  bool m_indexed;
+
+  void add(QueryResult &page)
+  {
+    for (int i=0; i < (int)page.rows.size(); i++) {
+      QueryRow &row = page.rows[i];
+      Result result;
+
+      for (int col=0; col < (int)page.columns.size(); col++)
+        result[(char *)page.columns[col].c_str()] = row.type[col] == SQLITE_NULL ? NULL : (char *)row.text[col].c_str();
+      addRow(result);
+    }
+    debug("fetched %d rows\n", (int)page.rows.size());
+  }
+
+  void addJumps(QueryResult &index)
+  {
+    int row = 0;
+
+    m_indexed = true;
+    for (int i=0; i < (int)index.rows.size(); i++) {
+      QueryRow &letter = index.rows[i];
+      if (!letter.text[0].empty()) {
+        MenuJump jump;
+        jump.letter = letter.text[0];
+        jump.row = row;
+        m_jumps.push_back(jump);
+      }
+      row += strtol(letter.text[1].c_str(), NULL, 10);
+    }
+  }
+
+protected:
+  FontHandle m_name_font;
+  FontHandle m_field_font;
+  ImageHandle m_art;
+
+  virtual void addRow(Result &result) = 0;
+
+  // Columns 0 and 1 of the query are key and tie, followed by columns.
+  void setQuery(const char *key, const char *tie, const char *columns, const char *from, 
+                const char *where, const char *group=NULL)
+  {
+    QueryLoader *loader = m_app->loader();
+    std::vector<std::string> sql, index;
+
+    m_pager = new Pager(key, tie, columns, from, where, group);
+    sql.push_back(m_pager->first(MUSIC_PAGE_SIZE));
+    index.push_back(m_pager->index());
+    if (loader) {
+      m_load = loader->request(sql);
+      m_index_load = loader->request(index);
+      m_loading = true;
+    }
+    else {
+      Query query(m_app->database(), sql[0].c_str());
+      QueryResult page;
+      QueryLoader::load(query, &page);
+      m_pager->add(page, MUSIC_PAGE_SIZE);
+      add(page);
+    }
+    setSource(this);
+  }
 
-  std::vector<class Song> m_songs;
+  // Without a loader the list is counted on the first jump.  Until the
+  // loader has counted it, jumps do nothing.
+  void index()
+  {
+    QueryResult index;
+
+    if (m_indexed || m_index_load || !m_pager) return;
+    Query query(m_app->database(), m_pager->index().c_str());
+    QueryLoader::load(query, &index);
+    addJumps(index);
+  }
 
 public:
-  SongsMenu(Application *application, Album *album=NULL) 
-    : Menu(application, "Songs")
+  PagedMenu(Application *application, const char *title, const char *art)
+    : Menu(application, title),
+      m_pager(NULL),
+      m_load(0),
+      m_index_load(0),
+      m_indexed(false)
+  {
+    Renderer *r = m_app->renderer();
+
+    m_name_font = r->fontHandle(BOLD_FONT, 23);
+    m_field_font = r->fontHandle(REGULAR_FONT, 18);
+    m_art = r->imageHandle(art);
+  }
+
+  ~PagedMenu()
+  {
+    if (m_load) m_app->loader()->cancel(m_load);
+    if (m_index_load) m_app->loader()->cancel(m_index_load);
+    delete m_pager;
+  }
+
+  // Fetches at least a page, or up to rows in one go for jumps.
+  bool fetch(int rows)
+  {
+    QueryResult page;
+
+    if (m_load || !m_pager || !m_pager->next(m_app->database(), maximum(MUSIC_PAGE_SIZE, rows - count()), &page)) 
+      return false;
+    add(page);
+    return true;
+  }
+
+  bool handleIdle()
+  {
+    std::vector<QueryResult> results;
+
+    if (m_load && m_app->loader()->finished(m_load, &results)) {
+      m_load = 0;
+      m_loading = false;
+      m_pager->add(results[0], MUSIC_PAGE_SIZE);
+      add(results[0]);
+      setSource(this);
+      setDirty();
+    }
+    if (m_index_load && m_app->loader()->finished(m_index_load, &results)) {
+      m_index_load = 0;
+      addJumps(results[0]);
+    }
+    return Menu::handleIdle();
+  }
+};
+
+struct SongRow
+{
+  int song_id;
+  std::string title;
+};
+
+// Lists only ids and titles; the rest of a song is looked up when it is
+// shown or played.
+class SongsMenu : public PagedMenu
+{
+protected:
+
+  std::vector<SongRow> m_songs;
+  Song *m_song;
+
+  Song *song(int index)
   {
     Database *db = m_app->database();
     Result *result;
-    char sql[512];
+    int song_id = m_songs[index].song_id;
+
+    if (m_song && m_song->song_id == song_id) return m_song;
+    if (!db->execute("select songs.rowid, path, title, artist, album, genre, length from songs, albums, artists, genres where artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and songs.rowid=%d", song_id) ||
+        !(result = db->next()))
+      return NULL;
+    delete m_song;
+    m_song = new Song(*result);
+    return m_song;
+  }
+
+  void addRow(Result &result)
+  {
+    SongRow row;
+    row.song_id = strtol(result["rowid"], NULL, 10);
+    row.title = result["title"];
+    m_songs.push_back(row);
+  }
+
+  SongsMenu(Application *application, const char *title)
+    : PagedMenu(application, title, "data/unknown_album.png"),
+      m_song(NULL)
+  {
+  }
+
+public:
+  SongsMenu(Application *application, Album *album=NULL) 
+    : PagedMenu(application, "Songs", "data/unknown_album.png"),
+      m_song(NULL)
+  {
+    char where[512];
 
     if (album) setLabel(album->album);
 
     if (album && album->num_artists > 1)
-      sqlite3_snprintf(sizeof(sql), sql, "select songs.rowid, path, title, artist, album, genre, length from songs, albums, artists, genres where artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album=%Q order by upper(title) limit 10000", album->album);
+      sqlite3_snprintf(sizeof(where), where, "artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album=%Q", album->album);
     else if (album && album->genre_id)
-      sqlite3_snprintf(sizeof(sql), sql, "select songs.rowid, path, title, artist, album, genre, length from songs, albums, artists, genres where artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album_id=%d and genre_id=%d order by upper(title) limit 10000", album->album_id, album->genre_id);
+      sqlite3_snprintf(sizeof(where), where, "artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album_id=%d and genre_id=%d", album->album_id, album->genre_id);
     else if (album)
-      sqlite3_snprintf(sizeof(sql), sql, "select songs.rowid, path, title, artist, album, genre, length from songs, albums, artists, genres where artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album_id=%d order by upper(title) limit 10000", album->album_id);
+      sqlite3_snprintf(sizeof(where), where, "artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id and album_id=%d", album->album_id);
     else
-      sqlite3_snprintf(sizeof(sql), sql, "select songs.rowid, path, title, artist, album, genre, length from songs, albums, artists, genres where artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id order by upper(title) limit 10000");
-    if (db->execute(sql))
-      while ((result=db->next())) {
-        m_songs.push_back(Song(*result));
-        new ArrowItem(this, (*result)["title"]);
-      }
+      sqlite3_snprintf(sizeof(where), where, "artists.rowid=artist_id and albums.rowid=album_id and genres.rowid=genre_id");
+    setQuery("title", "songs.rowid", "songs.rowid", "songs, albums, artists, genres", where);
+  }
+
+  ~SongsMenu()
+  {
+    delete m_song;
+  }
+
+  int count()
+  {
+    return m_songs.size();
+  }
+
+  MenuItem *row(Menu *menu, int index)
+  {
+    return new ArrowItem(menu, m_songs[index].title.c_str());
   }
 
   void selectItem(MenuItem *menuItem)
   {
-    Song &song = m_songs[menuItem->index()];
-    if (strcmp(m_app->audio()->nowPlaying(), song.path)) {
-      if (!m_app->audio()->open(song.path, song.artist, song.album, song.title, song.genre, song.length)) 
+    Song *song = this->song(menuItem->index());
+    if (!song) return;
+    if (strcmp(m_app->audio()->nowPlaying(), song->path)) {
+      if (!m_app->audio()->open(song->path, song->artist, song->album, song->title, song->genre, song->length)) 
         return;
     }
     m_app->go(new Player(m_app));        
@@ -149,58 +344,157 @@ public:
 
   bool paintDetails(MenuItem *menuItem)
   {
-    Song &song = m_songs[menuItem->index()];
+    Song *song = this->song(menuItem->index());
     Renderer *r = m_app->renderer();
     char text[256];
-    r->image(143, 92, "data/unknown_album.png");
-    r->font(BOLD_FONT, 23);
+    if (!song) return false;
+    r->image(143, 92, m_art);
+    r->font(m_name_font);
     r->color(0xff, 0xff, 0xff, 0xff);
-    r->text(81, 518, song.title, 504);
+    r->text(81, 518, song->title, 504);
     r->color(0x99, 0x99, 0x99, 0xff);
-    r->font(REGULAR_FONT, 18);    
+    r->font(m_field_font);
     r->text(148, 563, "Album:", 0, JUSTIFY_RIGHT);
     r->text(148, 586, "Artist:", 0, JUSTIFY_RIGHT);
     r->text(148, 609, "Genre:", 0, JUSTIFY_RIGHT);
     r->text(148, 632, "Length:", 0, JUSTIFY_RIGHT);
     r->color(0xff, 0xff, 0xff, 0xff);
-    r->text(153, 563, song.album, 432);
-    r->text(153, 586, song.artist, 432);
-    r->text(153, 609, song.genre, 432);
-    sprintf(text, "%d:%02d", song.length / 60, song.length % 60); 
+    r->text(153, 563, song->album, 432);
+    r->text(153, 586, song->artist, 432);
+    r->text(153, 609, song->genre, 432);
+    sprintf(text, "%d:%02d", song->length / 60, song->length % 60); 
     r->text(153, 632, text, 0);
     r->color(0x33, 0x33, 0x33, 0xff);
     r->rect(81, 531, 504, 3);
     r->rect(81, 647, 504, 3);
+    return true;
   }
 };
 
-class AlbumsMenu : public Menu
+// Songs matching what is typed, searched for again after every pause
+// in typing.  A keystroke cancels the search still running.
+class SearchMenu : public SongsMenu
+{
+private:
+
+  Searcher m_searcher;
+  std::string m_terms;
+  int m_search_timer;
+
+  void setTerms(const std::string &terms)
+  {
+    Scheduler *scheduler = m_app->renderer()->scheduler();
+
+    m_terms = terms;
+    m_searcher.cancel();
+    scheduler->cancel(m_search_timer);
+    m_search_timer = scheduler->schedule(this, SEARCH_DELAY);
+    setLabel(("Search: " + m_terms).c_str());
+    m_title.font = NULL;
+    setDirtyRegion(Box(MENU_X - 60, 0, 445 + 120, m_top));
+  }
+
+public:
+  SearchMenu(Application *application)
+    : SongsMenu(application, "Search: "),
+      m_searcher(application->renderer()->backend()),
+      m_search_timer(0)
+  {
+    m_searcher.start();
+    setSource(this);
+  }
+
+  ~SearchMenu()
+  {
+    m_app->renderer()->scheduler()->cancel(m_search_timer);
+    m_searcher.stop();
+  }
+
+  bool handleEvent(Event &event)
+  {
+    if ((int)event.key >= DIKS_SPACE && (int)event.key <= DIKS_TILDE) {
+      setTerms(m_terms + (char)event.key);
+      return true;
+    }
+    if ((int)event.key == DIKS_BACKSPACE) {
+      if (!m_terms.empty()) setTerms(m_terms.substr(0, m_terms.size() - 1));
+      return true;
+    }
+    return SongsMenu::handleEvent(event);
+  }
+
+  void handleTimer(int timer)
+  {
+    if (timer == m_search_timer) {
+      m_search_timer = 0;
+      m_searcher.request(m_terms.c_str());
+      return;
+    }
+    SongsMenu::handleTimer(timer);
+  }
+
+  bool handleIdle()
+  {
+    std::vector<SearchResult> results;
+    std::string terms;
+
+    if (m_searcher.finished(&terms, &results) && terms == m_terms) {
+      m_songs.clear();
+      for (int i=0; i < results.size(); i++) {
+        SongRow row;
+        row.song_id = results[i].song_id;
+        row.title = results[i].title;
+        m_songs.push_back(row);
+      }
+      setSource(this);
+      setDirtyRegion(Box(0, 0, m_box.w, m_box.h));
+    }
+    return SongsMenu::handleIdle();
+  }
+};
+
+class AlbumsMenu : public PagedMenu
 {
 private:
 
   std::vector<class Album> m_albums;
 
+  void addRow(Result &result)
+  {
+    m_albums.push_back(Album(result));
+  }
+
 public:
   AlbumsMenu(Application *application, Artist *artist=NULL) 
-    : Menu(application, "Albums")
+    : PagedMenu(application, "Albums", "data/unknown_album.png")
   {
-    Database *db = m_app->database();
-    Result *result;
-    char sql[512];
+    const char *columns = "albums.rowid, count(1) as tracks, sum(length) as length, genre, artist";
+    const char *from = "genres, albums, artists, songs";
+    char where[256];
 
     if (artist) setLabel(artist->artist);
     
     if (artist && artist->genre_id) 
-      sqlite3_snprintf(sizeof(sql), sql, "select albums.rowid, count(1) as tracks, sum(length) as length, genre, artist, album from genres, albums, artists, songs where genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id and artist_id=%d and genre_id=%d group by album_id order by upper(album)", artist->artist_id, artist->genre_id);
+      sqlite3_snprintf(sizeof(where), where, "genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id and artist_id=%d and genre_id=%d", artist->artist_id, artist->genre_id);
     else if (artist)
-      sqlite3_snprintf(sizeof(sql), sql, "select albums.rowid, count(1) as tracks, sum(length) as length, genre, artist, album from genres, albums, artists, songs where genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id and artist_id=%d group by album_id order by upper(album)", artist->artist_id);
+      sqlite3_snprintf(sizeof(where), where, "genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id and artist_id=%d", artist->artist_id);
+    if (artist)
+      setQuery("album", "albums.rowid", columns, from, where, "album_id");
     else
-      sqlite3_snprintf(sizeof(sql), sql, "select count(distinct artist_id) as num_artists, albums.rowid, count(1) as tracks, sum(length) as length, genre, artist, album from genres, albums, artists, songs where genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id group by album order by upper(album)");      
-    if (db->execute(sql))
-      while ((result=db->next())) {
-        m_albums.push_back(Album(*result));
-	new ArrowItem(this, (*result)["album"]);
-      }
+      // same named albums of different artists are listed once, and
+      // albums without a name once among them
+      setQuery("album", "album", "count(distinct artist_id) as num_artists, albums.rowid, count(1) as tracks, sum(length) as length, genre, artist", 
+               from, "genres.rowid=genre_id and artists.rowid=artist_id and albums.rowid=album_id", "ifnull(album, '')");
+  }
+
+  int count()
+  {
+    return m_albums.size();
+  }
+
+  MenuItem *row(Menu *menu, int index)
+  {
+    return new ArrowItem(menu, m_albums[index].album);
   }
 
   void selectItem(MenuItem *menuItem)
@@ -215,12 +509,12 @@ public:
     Album &album = m_albums[menuItem->index()];
     Renderer *r = m_app->renderer();
     char text[256];
-    r->image(143, 92, "data/unknown_album.png");
-    r->font(BOLD_FONT, 23);
+    r->image(143, 92, m_art);
+    r->font(m_name_font);
     r->color(0xff, 0xff, 0xff, 0xff);
     r->text(81, 518, album.album, 504);
     r->color(0x99, 0x99, 0x99, 0xff);
-    r->font(REGULAR_FONT, 18);    
+    r->font(m_field_font);
     r->text(148, 563, "Artist:", 0, JUSTIFY_RIGHT);
     r->text(148, 586, "Genre:", 0, JUSTIFY_RIGHT);
     r->text(148, 609, "Tracks:", 0, JUSTIFY_RIGHT);
@@ -235,33 +529,43 @@ public:
     r->color(0x33, 0x33, 0x33, 0xff);
     r->rect(81, 531, 504, 3);
     r->rect(81, 647, 504, 3);
+    return true;
   }
 };
 
-class ArtistsMenu : public Menu
+class ArtistsMenu : public PagedMenu
 {
 private:
   std::vector<class Artist> m_artists;
 
+  void addRow(Result &result)
+  {
+    m_artists.push_back(Artist(result));
+  }
+
 public:
   ArtistsMenu(Application *application, Genre *genre=NULL) 
-    : Menu(application, "Artists")
+    : PagedMenu(application, "Artists", "data/unknown_music.png")
   {
-    Database *db = m_app->database();
-    Result *result;
-    char sql[256];
+    char where[256];
 
     if (genre) {
       setLabel(genre->genre);
-      sqlite3_snprintf(sizeof(sql), sql, "select artists.rowid, artist, genre_id from artists, albums, songs where artists.rowid=artist_id and albums.rowid=album_id and genre_id=%d group by artist_id order by upper(artist)", genre->genre_id);
+      sqlite3_snprintf(sizeof(where), where, "artists.rowid=artist_id and albums.rowid=album_id and genre_id=%d", genre->genre_id);
+      setQuery("artist", "artists.rowid", "genre_id", "artists, albums, songs", where, "artist_id");
     }
     else
-      sqlite3_snprintf(sizeof(sql), sql, "select rowid, artist from artists order by upper(artist)");
-    if (db->execute(sql))
-      while ((result=db->next())) {
-        m_artists.push_back(Artist(*result));
-	new ArrowItem(this, (*result)["artist"]);
-      }
+      setQuery("artist", "artists.rowid", "artists.rowid", "artists", "1");
+  }
+
+  int count()
+  {
+    return m_artists.size();
+  }
+
+  MenuItem *row(Menu *menu, int index)
+  {
+    return new ArrowItem(menu, m_artists[index].artist);
   }
 
   void selectItem(MenuItem *menuItem)
@@ -272,28 +576,37 @@ public:
 
   bool paintDetails(MenuItem *menuItem)
   {
-    Renderer *r = m_app->renderer();
-    r->image(143, 92, "data/unknown_music.png");
+    m_app->renderer()->image(143, 92, m_art);
+    return true;
   }
 };
 
-class GenresMenu : public Menu
+class GenresMenu : public PagedMenu
 {
 private:
 
   std::vector<class Genre> m_genres;
 
+  void addRow(Result &result)
+  {
+    m_genres.push_back(Genre(result));
+  }
+
 public:
   GenresMenu(Application *application) 
-    : Menu(application, "Genres")
+    : PagedMenu(application, "Genres", "data/unknown_music.png")
   {
-    Database *db = m_app->database();
-    Result *result;
-    if (db->execute("select rowid, genre from genres order by upper(genre)"))
-      while ((result=db->next())) {
-        m_genres.push_back(Genre(*result));
-	new ArrowItem(this, (*result)["genre"]);
-      }
+    setQuery("genre", "genres.rowid", "genres.rowid", "genres", "1");
+  }
+
+  int count()
+  {
+    return m_genres.size();
+  }
+
+  MenuItem *row(Menu *menu, int index)
+  {
+    return new ArrowItem(menu, m_genres[index].genre);
   }
 
   void selectItem(MenuItem *menuItem)
@@ -304,34 +617,45 @@ public:
 
   bool paintDetails(MenuItem *menuItem)
   {
-    Renderer *r = m_app->renderer();
-    r->image(143, 92, "data/unknown_music.png");
+    m_app->renderer()->image(143, 92, m_art);
+    return true;
   }
 };
 
 MusicMenu::MusicMenu(Application *application)
   : Menu(application, "Music")
 {
+  m_art = m_app->renderer()->imageHandle("data/unknown_music.png");
   new ArrowItem(this, "Artists");
   new ArrowItem(this, "Albums");
   new ArrowItem(this, "Songs");
   new ArrowItem(this, "Genres");
+  new ArrowItem(this, "Search");
 }
 
-void MusicMenu::selectItem(MenuItem *menuItem)
+Screen *MusicMenu::build(MenuItem *menuItem)
 {
   if (!strcmp(menuItem->label(), "Artists"))
-    m_app->go(new ArtistsMenu(m_app));
+    return new ArtistsMenu(m_app);
   if (!strcmp(menuItem->label(), "Albums"))
-    m_app->go(new AlbumsMenu(m_app));
+    return new AlbumsMenu(m_app);
   if (!strcmp(menuItem->label(), "Songs"))
-    m_app->go(new SongsMenu(m_app));
+    return new SongsMenu(m_app);
   if (!strcmp(menuItem->label(), "Genres"))
-    m_app->go(new GenresMenu(m_app));
+    return new GenresMenu(m_app);
+  if (!strcmp(menuItem->label(), "Search"))
+    return new SearchMenu(m_app);
+  return NULL;
+}
+
+void MusicMenu::selectItem(MenuItem *menuItem)
+{
+  Screen *screen = take(menuItem);
+  if (screen) m_app->go(screen);
 }
 
 bool MusicMenu::paintDetails(MenuItem *menuItem)
 {
-  Renderer *r = m_app->renderer();
-  r->image(143, 92, "data/unknown_music.png");
+  m_app->renderer()->image(143, 92, m_art);
+  return true;
 }
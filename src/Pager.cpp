@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Pager.h"
+
+Pager::Pager(const char *key, const char *tie, const char *columns, const char *from, 
+             const char *where, const char *group)
+  : m_next(NULL),
+    m_tie_type(SQLITE_NULL),
+    m_started(false),
+    m_done(false)
+{
+  const char *name = strrchr(key, '.');
+  std::string k = std::string("ifnull(") + key + ", '')";
+  std::string t = std::string("ifnull(") + tie + ", '')";
+  std::string grouped = group ? std::string(" group by ") + group : std::string();
+
+  // the key keeps its column name for the rows
+  m_select = "select " + k + " as " + (name ? name + 1 : key) + ", " + t + ", " + columns + 
+    " from " + from + " where " + where;
+  m_order = grouped + " order by " + k + " collate nocase, " + t;
+  m_after = " and " + k + " collate nocase >= ?1 and (" + k + " collate nocase > ?1 or " + t + " > ?2)";
+  m_index = "select upper(substr(pager_key, 1, 1)) as letter, count(1) from (select " + k + " as pager_key from " + 
+    from + " where " + where + grouped + ") group by letter order by letter collate nocase";
+}
+
+Pager::~Pager()
+{
+  delete m_next;
+}
+
+std::string Pager::first(int limit)
+{
+  char sql[32];
+
+  sprintf(sql, " limit %d", limit);
+  return m_select + m_order + sql;
+}
+
+// Moves past the rows of page, which asked for limit rows.
+void Pager::add(const QueryResult &page, int limit)
+{
+  if (!page.rows.empty()) {
+    const QueryRow &row = page.rows.back();
+    m_key = row.text[0];
+    m_tie = row.text[1];
+    m_tie_type = row.type[1];
+  }
+  m_started = true;
+  m_done = (int)page.rows.size() < limit;
+}
+
+// Fetches up to limit rows after those added so far.  Returns false
+// once there are none left.
+bool Pager::next(Database *db, int limit, QueryResult *page)
+{
+  if (!m_started || m_done) return false;
+
+  if (!m_next) m_next = new Query(db, (m_select + m_after + m_order + " limit ?3").c_str());
+  m_next->reset();
+  m_next->bind(1, m_key.c_str());
+  if (m_tie_type == SQLITE_INTEGER) m_next->bind(2, (int)strtol(m_tie.c_str(), NULL, 10));
+  else m_next->bind(2, m_tie.c_str());
+  m_next->bind(3, limit);
+  if (!QueryLoader::load(*m_next, page)) return false;
+  add(*page, limit);
+  return !page->rows.empty();
+}
@@ -0,0 +1,60 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <string>
+#include "Database.h"
+#include "QueryLoader.h"
+
+// Pages through the rows of a query in case insensitive order of a key
+// column.  Each page continues after the key and tie breaker (unique
+// among equal keys) of the last row, so rows sharing a key are neither
+// skipped nor repeated.  A NULL key sorts as an empty one.  Columns 0
+// and 1 of each row are key and tie, followed by the columns asked for.
+
+class Pager
+{
+ private:
+  std::string m_select;
+  std::string m_order;
+  std::string m_after;
+  std::string m_index;
+  Query *m_next;
+  std::string m_key;
+  std::string m_tie;
+  int m_tie_type;
+  bool m_started;
+  bool m_done;
+
+ public:
+  Pager(const char *key, const char *tie, const char *columns, const char *from, 
+        const char *where, const char *group = NULL);
+  ~Pager();
+  std::string first(int limit);
+  // Counts the rows by the leading character of the key, in page order.
+  const std::string &index() { return m_index; }
+  bool started() { return m_started; }
+  bool done() { return m_done; }
+  void add(const QueryResult &page, int limit);
+  bool next(Database *db, int limit, QueryResult *page);
+};
+
+#endif
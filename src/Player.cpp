@@ -23,6 +23,15 @@
 Player::Player(Application *application)
   : Screen(application)
 {
+  Renderer *r = m_app->renderer();
+
+  m_title_font = r->fontHandle(BOLD_FONT, 37);
+  m_artist_font = r->fontHandle(REGULAR_FONT, 29);
+  m_time_font = r->fontHandle(BOLD_FONT, 18);
+  m_album = r->imageHandle("data/unknown_album.png");
+  m_bar = r->imageHandle("data/position_bar.png");
+  m_knob = r->imageHandle("data/position_knob.png");
+  m_progress_timer = r->scheduler()->schedule(this, PLAYER_PROGRESS_PERIOD, PLAYER_PROGRESS_PERIOD);
 }
 
 Player::~Player()
@@ -45,32 +54,37 @@ bool Player::handleEvent(Event &event)
     if (!audio->isStopped()) audio->forward();
     break;
   }
+  setDirtyRegion(Box(570, 420, 620, 175));
 
   return true;
 }
 
 bool Player::handleIdle()
+{
+  return dirty();
+}
+
+void Player::handleTimer(int timer)
 {
   setDirtyRegion(Box(570, 420, 620, 175));
-  return true;
 }
 
 void Player::paint()
 {
   Renderer *r = m_app->renderer();
   int buffer = r->activeBuffer();
-  Box dirtyBox = getDirtyRegion(buffer);
+  Region dirty = getDirtyRegion(buffer);
   Audio *a = m_app->audio();
   char time[10];
   int progress;
 
-  if (dirtyBox & Box(0, 0, 560, m_box.h)) {
+  if (dirty & Box(0, 0, 560, m_box.h)) {
     r->color(0x0, 0x0, 0x0, 0xff);
     r->rect(0, 0, 1280, 720);
-    r->image(100, 210, "data/unknown_album.png");
+    r->image(100, 210, m_album);
   }
 
-  if (dirtyBox & Box(570, 420, 620, 175)) {
+  if (dirty & Box(570, 420, 620, 175)) {
     r->color(0x0, 0x0, 0x0, 0xff);
     r->rect(570, 420, 620, 175);
 
@@ -79,26 +93,26 @@ void Player::paint()
     }
     if (!a->isStopped()) {
       r->color(0xff, 0xff, 0xff, 0xff);
-      r->font(BOLD_FONT, 37);
+      r->font(m_title_font);
       if (a->title()) r->text(575, 455, a->title(), 550);
 
       r->color(0xad, 0xad, 0xad, 0xff);
-      r->font(REGULAR_FONT, 29);
+      r->font(m_artist_font);
       if (a->artist()) r->text(575, 490, a->artist(), 550);
       if (a->album()) r->text(575, 525, a->album(), 550);
 
       r->color(0xff, 0xff, 0xff, 0xff);
-      r->font(BOLD_FONT, 18);
+      r->font(m_time_font);
       sprintf(time, "%d:%02d", a->elapsed() / 60, a->elapsed() % 60); 
       r->text(575, 590, time);
       sprintf(time, "-%d:%02d", a->remaining() / 60, a->remaining() % 60); 
       r->text(1120, 590, time);
     
-      r->image(630, 573, "data/position_bar.png");
+      r->image(630, 573, m_bar);
       progress = (int)(465 * ((float)a->elapsed())/(a->elapsed()+a->remaining()));
       r->color(0x80, 0x80, 0x80, 0xff);
       r->rect(633, 576, 6+progress, 10);
-      r->image(633 + progress, 575, "data/position_knob.png", true);
+      r->image(633 + progress, 575, m_knob, true);
     }
   }
 
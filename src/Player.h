@@ -22,15 +22,28 @@
 
 #include "Screen.h"
 #include "Audio.h"
+#include "Renderer.h"
+
+#define PLAYER_PROGRESS_PERIOD 1000
 
 class Player : public Screen
 {
+ private:
+  int m_progress_timer;
+  FontHandle m_title_font;
+  FontHandle m_artist_font;
+  FontHandle m_time_font;
+  ImageHandle m_album;
+  ImageHandle m_bar;
+  ImageHandle m_knob;
+
  public:
   Player(Application *application);  
   virtual ~Player();
   virtual void paint();
   virtual bool handleEvent(Event &event);
   virtual bool handleIdle();
+  virtual void handleTimer(int timer);
 };
 
 #endif
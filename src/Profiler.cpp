@@ -0,0 +1,152 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+static const char *phase_names[PROFILE_PHASES] = { "event", "idle", "paint", "flip", "frame" };
+
+volatile sig_atomic_t Profiler::s_dump = 0;
+
+void Histogram::add(unsigned us)
+{
+  int bucket = minimum(us / PROFILE_BUCKET_US, PROFILE_BUCKETS - 1);
+
+  buckets[bucket]++;
+  count++;
+  total += us;
+  if (us > max) max = us;
+}
+
+// Upper bound of the bucket holding the p-th percentile, capped by max.
+unsigned Histogram::percentile(int p) const
+{
+  int rank = (count * p + 99) / 100, seen = 0;
+
+  for (int i=0; i < PROFILE_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank && seen > 0) return minimum((unsigned)(i + 1) * PROFILE_BUCKET_US, max);
+  }
+  return max;
+}
+
+Profiler::~Profiler()
+{
+  for (profile_map::const_iterator i=m_screens.begin(); i != m_screens.end(); i++)
+    delete i->second;
+}
+
+unsigned long long Profiler::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Profiler::requestDump(int signal)
+{
+  s_dump = 1;
+}
+
+void Profiler::installSignalHandler()
+{
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = requestDump;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGUSR1, &action, NULL) < 0) perror("sigaction");
+}
+
+ScreenProfile *Profiler::profile(const char *screen)
+{
+  profile_map::iterator i = m_screens.find(screen);
+
+  if (i != m_screens.end()) return i->second;
+
+  ScreenProfile *profile = new ScreenProfile;
+  memset(profile, 0, sizeof(ScreenProfile));
+  m_screens[screen] = profile;
+  return profile;
+}
+
+void Profiler::record(const char *screen, ProfilePhase phase, unsigned us)
+{
+  profile(screen)->phases[phase].add(us);
+}
+
+void Profiler::frame(const char *screen, int draws, int area)
+{
+  ScreenProfile *p = profile(screen);
+
+  p->frames++;
+  p->draws += draws;
+  p->max_draws = maximum(p->max_draws, draws);
+  p->area += area;
+  p->max_area = maximum(p->max_area, area);
+}
+
+void Profiler::write(FILE *f)
+{
+  for (profile_map::const_iterator i=m_screens.begin(); i != m_screens.end(); i++) {
+    ScreenProfile *p = i->second;
+
+    fprintf(f, "%s: %d frames", i->first.c_str(), p->frames);
+    if (p->frames)
+      fprintf(f, ", %.1f draws (max %d), %.0f dirty pixels (max %d) per frame",
+              p->draws / p->frames, p->max_draws, p->area / p->frames, p->max_area);
+    fprintf(f, "\n");
+    for (int phase=0; phase < PROFILE_PHASES; phase++) {
+      const Histogram &h = p->phases[phase];
+      if (!h.count) continue;
+      fprintf(f, "  %-6s %6d calls, p50 %6.2f ms, p95 %6.2f ms, max %7.2f ms, mean %6.2f ms\n",
+              phase_names[phase], h.count, h.percentile(50) / 1000.0, h.percentile(95) / 1000.0,
+              h.max / 1000.0, h.total / h.count / 1000.0);
+    }
+  }
+}
+
+bool Profiler::dump(const char *path)
+{
+  FILE *f = fopen(path, "w");
+
+  if (!f) {
+    fprintf(stderr, "Could not write profile to %s\n", path);
+    return false;
+  }
+  write(f);
+  fclose(f);
+  debug("profile written to %s\n", path);
+  return true;
+}
+
+void Profiler::poll()
+{
+  if (!s_dump) return;
+  s_dump = 0;
+  dump();
+}
+
+void Profiler::summarize()
+{
+  write(stderr);
+}
@@ -0,0 +1,84 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <map>
+#include <string>
+
+#define PROFILE_BUCKET_US 250
+#define PROFILE_BUCKETS 400
+#define PROFILE_DUMP_FILE "profile.txt"
+
+typedef enum { PROFILE_EVENT, PROFILE_IDLE, PROFILE_PAINT, PROFILE_FLIP, PROFILE_FRAME, PROFILE_PHASES } ProfilePhase;
+
+// Durations in microseconds, in PROFILE_BUCKET_US wide buckets.  The
+// last bucket also takes everything longer.
+struct Histogram
+{
+  int count;
+  unsigned max;
+  double total;
+  int buckets[PROFILE_BUCKETS];
+
+  void add(unsigned us);
+  unsigned percentile(int p) const;
+};
+
+struct ScreenProfile
+{
+  Histogram phases[PROFILE_PHASES];
+  int frames;
+  double draws;
+  int max_draws;
+  double area;
+  int max_area;
+};
+
+typedef std::map<std::string, ScreenProfile *> profile_map;
+
+// Frame timings per screen, keyed by screen label.  SIGUSR1 requests a
+// dump to PROFILE_DUMP_FILE, which is written from the main loop.
+
+class Profiler
+{
+ private:
+  profile_map m_screens;
+  static volatile sig_atomic_t s_dump;
+
+ private:
+  ScreenProfile *profile(const char *screen);
+  static void requestDump(int signal);
+  void write(FILE *f);
+
+ public:
+  ~Profiler();
+  static unsigned long long now();
+  void installSignalHandler();
+  void record(const char *screen, ProfilePhase phase, unsigned us);
+  void frame(const char *screen, int draws, int area);
+  bool dump(const char *path=PROFILE_DUMP_FILE);
+  void poll();
+  void summarize();
+};
+
+#endif
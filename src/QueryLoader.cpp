@@ -0,0 +1,187 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "QueryLoader.h"
+
+QueryLoader::QueryLoader(Backend *backend, const char *file)
+  : Thread(),
+    m_backend(backend),
+    m_file(file),
+    m_next_id(1),
+    m_loading(0),
+    m_cancelled(0)
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_cond, NULL);
+}
+
+QueryLoader::~QueryLoader()
+{
+  stop();
+  for (std::deque<LoadJob *>::const_iterator i = m_queue.begin(); i != m_queue.end(); i++)
+    delete *i;
+  for (std::map<int, LoadJob *>::const_iterator i = m_done.begin(); i != m_done.end(); i++)
+    delete i->second;
+  pthread_cond_destroy(&m_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void QueryLoader::stop()
+{
+  if (!m_running) return;
+  pthread_mutex_lock(&m_mutex);
+  m_running = false;
+  m_cancelled = m_loading;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+  Thread::stop();
+}
+
+bool QueryJob::run(Database *db)
+{
+  bool ok = true;
+
+  results.resize(sql.size());
+  for (int i=0; ok && i < (int)sql.size(); i++) {
+    Query query(db, sql[i].c_str());
+    ok = QueryLoader::load(query, &results[i]);
+  }
+  return ok;
+}
+
+// Queues job, which the loader owns until finished() hands it back.
+// Returns the id to collect it with.
+int QueryLoader::request(LoadJob *job)
+{
+  pthread_mutex_lock(&m_mutex);
+  job->id = m_next_id++;
+  m_queue.push_back(job);
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+  return job->id;
+}
+
+// Queues the statements to run one after the other.
+int QueryLoader::request(const std::vector<std::string> &sql)
+{
+  QueryJob *job = new QueryJob();
+
+  job->sql = sql;
+  return request(job);
+}
+
+void QueryLoader::cancel(int id)
+{
+  pthread_mutex_lock(&m_mutex);
+  if (m_loading == id) m_cancelled = id;
+  std::map<int, LoadJob *>::iterator done = m_done.find(id);
+  if (done != m_done.end()) {
+    delete done->second;
+    m_done.erase(done);
+  }
+  for (std::deque<LoadJob *>::iterator i = m_queue.begin(); i != m_queue.end(); i++) {
+    if ((*i)->id == id) {
+      delete *i;
+      m_queue.erase(i);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&m_mutex);
+}
+
+// Returns the job with id once it has run, or NULL.  The caller deletes
+// it.
+LoadJob *QueryLoader::finished(int id)
+{
+  LoadJob *job = NULL;
+
+  pthread_mutex_lock(&m_mutex);
+  std::map<int, LoadJob *>::iterator i = m_done.find(id);
+  if (i != m_done.end()) {
+    job = i->second;
+    m_done.erase(i);
+  }
+  pthread_mutex_unlock(&m_mutex);
+  return job;
+}
+
+// Collects the rows of the statements of a request(sql).
+bool QueryLoader::finished(int id, std::vector<QueryResult> *results)
+{
+  QueryJob *job = (QueryJob *)finished(id);
+
+  if (!job) return false;
+  results->swap(job->results);
+  delete job;
+  return true;
+}
+
+// Copies out the rows of query, returning false if it was interrupted.
+bool QueryLoader::load(Query &query, QueryResult *result)
+{
+  result->columns.clear();
+  result->rows.clear();
+  for (int col=0; col < query.columns(); col++) 
+    result->columns.push_back(query.name(col));
+  while (query.step()) {
+    QueryRow row;
+    for (int col=0; col < result->columns.size(); col++) {
+      row.type.push_back(query.type(col));
+      row.text.push_back(query.text(col) ? query.text(col) : "");
+    }
+    result->rows.push_back(row);
+  }
+  return !query.interrupted();
+}
+
+int QueryLoader::progress(void *arg)
+{
+  QueryLoader *loader = (QueryLoader *)arg;
+  return loader->m_cancelled && loader->m_cancelled == loader->m_loading;
+}
+
+void QueryLoader::run()
+{
+  Database db(m_file.c_str());
+
+  db.progress(progress, this);
+  pthread_mutex_lock(&m_mutex);
+  while (m_running) {
+    if (m_queue.empty()) {
+      pthread_cond_wait(&m_cond, &m_mutex);
+      continue;
+    }
+    LoadJob *job = m_queue.front();
+    m_queue.pop_front();
+    m_loading = job->id;
+    pthread_mutex_unlock(&m_mutex);
+
+    bool ok = job->run(&db);
+
+    pthread_mutex_lock(&m_mutex);
+    if (ok && m_cancelled != job->id) {
+      m_done[job->id] = job;
+      m_backend->wakeUp();
+    }
+    else
+      delete job;
+    m_loading = 0;
+  }
+  pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,99 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUERYLOADER_H
+#define QUERYLOADER_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Thread.h"
+#include "Backend.h"
+#include "Database.h"
+
+struct QueryRow
+{
+  std::vector<std::string> text;
+  std::vector<int> type;
+};
+
+struct QueryResult
+{
+  std::vector<std::string> columns;
+  std::vector<QueryRow> rows;
+};
+
+// Work for the loader thread.  run() returns false if it was
+// interrupted.
+struct LoadJob
+{
+  int id;
+
+  LoadJob() : id(0) {}
+  virtual ~LoadJob() {}
+  virtual bool run(Database *db) = 0;
+};
+
+struct QueryJob : public LoadJob
+{
+  std::vector<std::string> sql;
+  std::vector<QueryResult> results;
+
+  virtual bool run(Database *db);
+};
+
+// Runs the queries and other loading of screens being built, with a
+// database connection of its own, so the UI keeps responding while they
+// run.  Jobs are served in order; cancel() drops a job, interrupting its
+// queries if it is running.
+
+class QueryLoader : public Thread
+{
+ private:
+  Backend *m_backend;
+  std::string m_file;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  int m_next_id;
+  int m_loading;
+  volatile int m_cancelled;
+  std::deque<LoadJob *> m_queue;
+  std::map<int, LoadJob *> m_done;
+
+ private:
+  static int progress(void *arg);
+
+ protected:
+  virtual void run();
+
+ public:
+  QueryLoader(Backend *backend, const char *file = DB_FILE);
+  virtual ~QueryLoader();
+  virtual void stop();
+  int request(LoadJob *job);
+  int request(const std::vector<std::string> &sql);
+  void cancel(int id);
+  LoadJob *finished(int id);
+  bool finished(int id, std::vector<QueryResult> *results);
+  static bool load(Query &query, QueryResult *result);
+};
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -27,17 +28,30 @@
 #include "Font.h"
 #include "Utils.h"
 #include "NMTSettings.h"
+#include "MemoryBackend.h"
+#ifndef HEADLESS
+#include "DirectFBBackend.h"
+#endif
 
 #define VIRTUAL_WIDTH 1280
 #define VIRTUAL_HEIGHT 720
 
+// Frames that changed more than this share of the screen are presented
+// by swapping buffers instead of copying the changed regions.
+#define FLIP_COPY_MAX_PERCENT 50
+
 Renderer::Renderer()
   : m_initialized(false),
     m_exit(false),
+    m_backend(NULL),
+    m_surface(NULL),
     m_image_loader(NULL),
     m_curr_buffer(0),
     m_scale(1.0),
-    m_videoMode(-1)
+    m_image_cache(&m_residency),
+    m_label_cache(&m_residency),
+    m_scheduler(&m_clock),
+    m_snapshot_id(0)
 {
   Font::init();
 }
@@ -45,64 +59,47 @@ Renderer::Renderer()
 Renderer::~Renderer()
 {
   if (m_initialized) destroy();
-  for (image_map::const_iterator i=m_image_cache.begin(); i != m_image_cache.end(); i++) {
-    Image *image = i->second;
-    if (image) {
-      if (image->dsc.preallocated[0].data)
-	free(image->dsc.preallocated[0].data);
-      delete image;    
-    }
-  }
   for (font_map::const_iterator i=m_font_cache.begin(); i != m_font_cache.end(); i++) {
     if (i->second) delete i->second;    
   }
   Font::finish();
+  if (m_backend) delete m_backend;
 }
 
-void Renderer::initialize(int argc, char **argv, NMTSettings * nmtSettings)
+void Renderer::initialize(int argc, char **argv, NMTSettings * nmtSettings, bool headless)
 {
-  if (DirectFBInit(&argc, &argv) != DFB_OK) {
-    fprintf(stderr, "Error in DirectFBInit!\n");
+  BOOST_ASSERT(nmtSettings != NULL);
+#ifdef HEADLESS
+  headless = true;
+#endif
+  if (headless) {
+    m_backend = new MemoryBackend();
   }
+#ifndef HEADLESS
   else {
-    BOOST_ASSERT(nmtSettings != NULL);
-    m_videoMode = nmtSettings->getVideoMode();
-    init();
+    DirectFBBackend *backend = new DirectFBBackend(argc, argv, nmtSettings->getVideoMode());
+    if (!backend->isValid()) {
+      delete backend;
+      return;
+    }
+    m_backend = backend;
   }
+#endif
+  init();
 }
 
 void Renderer::init()
 {
-  if (m_initialized) return;
+  if (m_initialized || !m_backend) return;
 
-  // Set Video mode, if requested.
-  // Must be done before DirectFBCreate()!
-  if (m_videoMode != -1)
-  {
-    setVideoMode(m_videoMode);
-  }
-
-  DFBSurfaceDescription dsc;
-
-  if (DirectFBCreate(&m_dfb) != DFB_OK) {
-    fprintf(stderr, "Error in DirectFBCreate!\n"); return;
+  if (!m_backend->open()) {
+    m_backend->close();
+    return;
   }
 
-  if (m_dfb->SetCooperativeLevel(m_dfb, DFSCL_EXCLUSIVE) != DFB_OK) {
-    fprintf(stderr, "Error in SetCooperativeLevel!\n"); return;
-  }
-  
-  dsc.flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_PIXELFORMAT);
-  dsc.caps  = (DFBSurfaceCapabilities)(DSCAPS_PRIMARY | DSCAPS_DOUBLE);
-  dsc.pixelformat = (DFBSurfacePixelFormat)DSPF_ARGB;
-  
-  if (m_dfb->CreateSurface( m_dfb, &dsc, &m_surface ) != DFB_OK) {
-    fprintf(stderr, "Error in CreateSurface!\n"); return;
-  }
-  
-  if (m_surface->GetSize (m_surface, &m_width, &m_height) != DFB_OK) {
-    fprintf(stderr, "Error in GetSize!\n"); return;
-  }
+  m_surface = new BatchSurface(m_backend->primary());
+  m_residency.setTarget(m_surface);
+  m_surface->getSize(&m_width, &m_height);
 
   m_scale = ((float)m_width) / VIRTUAL_WIDTH;
   m_width = VIRTUAL_WIDTH;
@@ -114,16 +111,8 @@ void Renderer::init()
   rect(0,0,m_width, m_height); flip();
   rect(0,0,m_width, m_height); flip();
 
-  if (m_dfb->GetInputDevice (m_dfb, INPUT_DEVICE, &m_input) != DFB_OK) {
-    fprintf(stderr, "Error in GetInputDevice!\n"); return;    
-  }
-  
-  if (m_input->CreateEventBuffer (m_input, &m_eventBuffer) != DFB_OK) {
-    fprintf(stderr, "Error in CreateEventBuffer!\n"); return;    
-  }
-
-  // m_image_loader = new ImageLoader();
-  // m_image_loader->start();
+  m_image_loader = new ImageLoader(m_backend, &m_disk_cache);
+  m_image_loader->start();
 
   m_exit = false;
   m_initialized = true;
@@ -134,464 +123,77 @@ void Renderer::destroy()
   if (!m_initialized) return;
 
   if (m_image_loader) delete m_image_loader;
-
-  for (image_map::const_iterator i=m_image_cache.begin(); i != m_image_cache.end(); i++) {
-    if (i->second && i->second->surface) {
-      i->second->surface->Release(i->second->surface);    
-      i->second->surface = NULL;
-    }
+  m_image_loader = NULL;
+  for (int i=0; i < m_pending_images.size(); i++)
+    m_pending_images[i].image->pending = false;
+  m_pending_images.clear();
+
+  m_surface->flush();
+  m_image_cache.releaseSurfaces();
+  m_label_cache.releaseSurfaces();
+  for (std::list<Snapshot *>::const_iterator i=m_snapshots.begin(); i != m_snapshots.end(); i++) {
+    m_residency.evict(*i);
   }
+  dropSnapshots();
 
   for (font_map::const_iterator i=m_font_cache.begin(); i != m_font_cache.end(); i++) {
     if (i->second) i->second->clearCache();    
   }
 
-  m_input->Release(m_input);
-  m_surface->Release(m_surface);
-  m_dfb->Release (m_dfb);
+  m_residency.setTarget(NULL);
+  delete m_surface;
+  m_surface = NULL;
+  m_backend->close();
 
   m_initialized = false;
 }
 
-void Renderer::setVideoMode(int videoMode)
-{
-  int full_width;
-  int full_height;
-  char dfb_mode[32];
-	char * dtv_signal = NULL;
-	char * dtv_tv_standard = NULL;
-	char * dtv_connector = NULL;
-	char * component_signal = NULL;
-	char * component_tv_standard = NULL;
-	char * component_connector = NULL;
-	char * analog_signal = NULL;
-	char * analog_tv_standard = NULL;
-	char * analog_connector = NULL;
-
-  debug("Set video mode: %d\n", videoMode);
-
-  switch (videoMode)
-  {
-#if 0
-    case (0):
-    {
-      debug("Mode: Auto\n");
-
-      //! \todo How should this be implemented?
-    }
-    break;
-#endif
-
-    case (1):
-    {
-      debug("Mode: Composite NTSC\n");
-
-      full_width = 720;
-      full_height = 480;
-      analog_signal = "ntsc";
-      analog_tv_standard = "ntsc";
-      analog_connector = "yc";  // or scart ?
-    }
-    break;
-
-    case (2):
-    {
-      debug("Mode: Composite PAL\n");
-
-      full_width = 720;
-      full_height = 576;
-      analog_signal = "pal";
-      analog_tv_standard = "pal";
-      analog_connector = "yc";  // or scart ?
-    }
-    break;
-
-    case (3):
-    {
-      debug("Mode: Component NTSC 480i 60Hz\n");
-
-      full_width = 720;
-      full_height = 480;
-      component_signal = "edtv";  // is 480 ntsc / 576 pal
-      component_tv_standard = "hdtv60";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (4):
-    {
-      debug("Mode: Component PAL 576i 50Hz\n");
-
-      full_width = 720;
-      full_height = 576;
-      component_signal = "edtv";  // is 480 ntsc / 576 pal
-      component_tv_standard = "hdtv50";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (5):
-    {
-      debug("Mode: Component 480p 60Hz\n");
-
-      full_width = 720;
-      full_height = 480;
-      //! \todo How to force 480p?
-      component_signal = "edtv";
-      component_tv_standard = "hdtv60";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (6):
-    {
-      debug("Mode: Component 720p 60Hz\n");
-
-      full_width = 1280;
-      full_height = 720;
-      component_signal = "720p";
-      component_tv_standard = "hdtv60";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (7):
-    {
-      debug("Mode: Component 1080p 60Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      component_signal = "1080p";
-      component_tv_standard = "hdtv60";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (8):
-    {
-      debug("Mode: Component 1080i 60Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      component_signal = "1080i";
-      component_tv_standard = "hdtv60";
-      component_connector = "ycrcb";
-    }
-    break;
-
-#if 0
-    case (9):
-    {
-      debug("Mode: HDMI 480p 60Hz\n");
-
-      //! \todo Illegal mode?!? Not supported by DFB?
-
-      full_width = 720;
-      full_height = 480;
-    }
-    break;
-#endif
-
-    case (10):
-    {
-      debug("Mode: HDMI 720p 60Hz\n");
-
-      full_width = 1280;
-      full_height = 720;
-      dtv_signal = "720p";
-      dtv_tv_standard = "hdtv60";
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    case (11):
-    {
-      debug("Mode: Component 1080p 24Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      dtv_signal = "1080p24";
-      dtv_tv_standard = "hdtv60"; // should this also be set?
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    case (13):
-    {
-      debug("Mode: Component 720p 50Hz\n");
-
-      full_width = 1280;
-      full_height = 720;
-      component_signal = "720p";
-      component_tv_standard = "hdtv50";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (14):
-    {
-      debug("Mode: Component 1080p 50Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      component_signal = "1080p";
-      component_tv_standard = "hdtv50";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (15):
-    {
-      debug("Mode: Component 1080i 50Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      component_signal = "1080i";
-      component_tv_standard = "hdtv50";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (16):
-    {
-      debug("Mode: HDMI 720p 50Hz\n");
-
-      full_width = 1280;
-      full_height = 720;
-      dtv_signal = "720p";
-      dtv_tv_standard = "hdtv50";
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    case (18):
-    {
-      debug("Mode: HDMI 1080p 50Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      dtv_signal = "1080p";
-      dtv_tv_standard = "hdtv50";
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    case (29):
-    {
-      debug("Mode: HDMI 1080p 60Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      dtv_signal = "1080p";
-      dtv_tv_standard = "hdtv60";
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    case (30):
-    {
-      debug("Mode: Component 576p 50Hz\n");
-
-      full_width = 720;
-      full_height = 576;
-      //! \todo How to force 576p?
-      component_signal = "edtv";
-      component_tv_standard = "hdtv50";
-      component_connector = "ycrcb";
-    }
-    break;
-
-    case (31):
-    {
-      debug("Mode: HDMI 576p 50Hz\n");
-
-      full_width = 720;
-      full_height = 576;
-      //! \todo Should EDID be used to configure special resolutions?
-      dtv_signal = "edid";
-      dtv_tv_standard = "hdtv50";
-      dtv_connector = "hdmi";
-    }
-    break;
- 
-    case (32):
-    {
-      debug("Mode: HDMI 1080i 60Hz\n");
-
-      full_width = 1920;
-      full_height = 1080;
-      dtv_signal = "1080i";
-      dtv_tv_standard = "hdtv60";
-      dtv_connector = "hdmi";
-    }
-    break;
-
-    default:
-    {
-      fprintf(stderr, "Unsupported video mode: %d!\n", videoMode);
-      return;
-    }
-    break;
-  }
-
-  // Set resolution (mode)
-	snprintf(dfb_mode, sizeof(dfb_mode), "%dx%d", full_width, full_height);
-  if (DirectFBSetOption("mode", dfb_mode) != DFB_OK)
-  {
-    fprintf(stderr, "Error setting mode: %s\n", dfb_mode);
-    return;
-  }
-
-  // Set which signals should be enabled
-  
-  // dtv
-  if (dtv_signal)
-  {
-		if (DirectFBSetOption ("dtv-signal", dtv_signal) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting dtv-signal: %s\n", dtv_signal);
-      return;
-    }
-
-		if (DirectFBSetOption ("dtv-tv-standard", dtv_tv_standard) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting dtv-tv-standard: %s\n", dtv_tv_standard);
-      return;
-    }
-
-		if (DirectFBSetOption ("dtv-connector", dtv_connector) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting dtv-connector: %s\n", dtv_connector);
-      return;
-    }
-  }
-  else
-  {
-    // Disable dtv signal
-		if (DirectFBSetOption ("dtv-signal", "none") != DFB_OK)
-    {
-      fprintf(stderr, "Error disabling dtv-signal\n");
-      return;
-    }
-  }
-
-  // component
-  if (component_signal)
-  {
-		if (DirectFBSetOption ("component-signal", component_signal) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting component-signal: %s\n", component_signal);
-      return;
-    }
-
-		if (DirectFBSetOption ("component-tv-standard", component_tv_standard) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting component-tv-standard: %s\n", component_tv_standard);
-      return;
-    }
-
-		if (DirectFBSetOption ("component-connector", component_connector) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting component-connector: %s\n", component_connector);
-      return;
-    }
-  }
-  else
-  {
-    // Disable component signal
-		if (DirectFBSetOption ("component-signal", "none") != DFB_OK)
-    {
-      fprintf(stderr, "Error disabling component-signal\n");
-      return;
-    }
-  }
-
-  // analog
-  if (analog_signal)
-  {
-		if (DirectFBSetOption ("analog-signal", analog_signal) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting analog-signal: %s\n", analog_signal);
-      return;
-    }
-
-		if (DirectFBSetOption ("analog-tv-standard", analog_tv_standard) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting analog-tv-standard: %s\n", analog_tv_standard);
-      return;
-    }
-
-		if (DirectFBSetOption ("analog-connector", analog_connector) != DFB_OK)
-    {
-      fprintf(stderr, "Error setting analog-connector: %s\n", analog_connector);
-      return;
-    }
-  }
-  else
-  {
-    // Disable component signal
-		if (DirectFBSetOption ("analog-signal", "none") != DFB_OK)
-    {
-      fprintf(stderr, "Error disabling analog-signal\n");
-      return;
-    }
-  }
-}
-
 void Renderer::loop(EventListener *listener)
 {
-  DFBInputEvent dfb_event;
   Event event;
 
   while (!m_exit) {
-    m_eventBuffer->WaitForEventWithTimeout(m_eventBuffer, 0, 100);
-    while (!m_exit && m_eventBuffer->GetEvent (m_eventBuffer, DFB_EVENT(&dfb_event)) == DFB_OK) {
-      if (dfb_event.type == DIET_KEYPRESS) {
-        event.type = EVENT_KEYPRESS;
-        event.key = (Key)dfb_event.key_symbol;
-        event.repeat = dfb_event.flags & DIEF_REPEAT;
-#ifdef NMT
-        if (event.key == (Key)DIKS_PAUSE) event.key = (Key)DIKS_PLAY;
-#endif
-        debug("got key: 0x%x 0x%x\n", (int)(event.key & 0xFF00), (int)(event.key & 0xFF));
-        if (!listener->handleEvent(event)) m_exit = true;
-      }
+    // Sleep until input, a finished image or the next timer deadline.
+    m_backend->waitForEvent(m_scheduler.timeout());
+    while (!m_exit && m_backend->getEvent(&event)) {
+      if (!listener->handleEvent(event)) m_exit = true;
     }
-    if (!listener->handleIdle()) m_exit = true;
+    m_scheduler.run();
+    if (!m_exit && !listener->handleIdle()) m_exit = true;
   }    
 }
 
-IDirectFBSurface *Renderer::createSurface(DFBSurfaceDescription *dsc)
+// Evicts least recently drawn surfaces from video memory until the new
+// surface fits.
+Surface *Renderer::createSurface(DFBSurfaceDescription *dsc)
 {
-  IDirectFBSurface *surface = NULL;
-  if (m_dfb->CreateSurface(m_dfb, dsc, &surface) != DFB_OK) {
-    fprintf(stderr, "Error creating surface2!\n");
-    surface = NULL;
-  }
-  return surface;  
+  Surface *surface;
+  int bytes = dsc->width * dsc->height * 4;
+
+  if (dsc->flags & DSDESC_PIXELFORMAT)
+    bytes = dsc->width * dsc->height * DFB_BYTES_PER_PIXEL(dsc->pixelformat);
+
+  while (!(surface = m_backend->createSurface(dsc)) && m_residency.reclaim(bytes));
+  if (!surface) m_residency.failed();
+  return surface;
 }
  
-IDirectFBSurface *Renderer::createSurface(int width, int height, int pixelFormat)
+Surface *Renderer::createSurface(int width, int height, int pixelFormat)
 {
   if (!width || !height) return NULL;
 
   DFBSurfaceDescription dsc;
-  IDirectFBSurface *surface = NULL;
   dsc.flags = (DFBSurfaceDescriptionFlags)(DSDESC_CAPS | DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT);
   dsc.caps = DSCAPS_NONE;
   dsc.width = width;
   dsc.height = height;
   dsc.pixelformat = (DFBSurfacePixelFormat)pixelFormat;
-  if (m_dfb->CreateSurface(m_dfb, &dsc, &surface) != DFB_OK) {
-    fprintf(stderr, "Error creating surface!\n");
-    surface = NULL;
-  }
-  return surface;
+  return createSurface(&dsc);
 }
 
 void Renderer::color(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
-  m_surface->SetColor(m_surface, r & 0xff, g & 0xff, b & 0xff, a & 0xff);
+  m_surface->setColor(r & 0xff, g & 0xff, b & 0xff, a & 0xff);
 }
 
 void Renderer::setClip(Box *box)
@@ -601,13 +203,13 @@ void Renderer::setClip(Box *box)
   scale(&clip.x2);
   scale(&clip.y1);
   scale(&clip.y2);
-  m_surface->SetClip(m_surface, &clip);
+  m_surface->setClip(&clip);
 }
 
 void Renderer::getClip(Box *box)
 {
   DFBRegion clip;
-  m_surface->GetClip(m_surface, &clip);
+  m_surface->getClip(&clip);
   unscale(&clip.x1);
   unscale(&clip.x2);
   unscale(&clip.y1);
@@ -624,7 +226,8 @@ void Renderer::rect(int x, int y, int w, int h)
   scale(&y);
   scale(&w);
   scale(&h);
-  m_surface->FillRectangle(m_surface, x, y, w, h);
+  m_surface->fillRectangle(x, y, w, h);
+  damage(x, y, w, h);
 }
 
 void Renderer::line(int x1, int y1, int x2, int y2, bool blend)
@@ -633,127 +236,382 @@ void Renderer::line(int x1, int y1, int x2, int y2, bool blend)
   scale(&y1);
   scale(&x2);
   scale(&y2);
-  if (blend) m_surface->SetDrawingFlags(m_surface, DSDRAW_BLEND);
-  m_surface->DrawLine(m_surface, x1, y1, x2, y2);
-  if (blend) m_surface->SetDrawingFlags(m_surface, DSDRAW_NOFX);
+  if (blend) m_surface->setDrawingFlags(DSDRAW_BLEND);
+  m_surface->drawLine(x1, y1, x2, y2);
+  damage(minimum(x1, x2), minimum(y1, y2), abs(x2 - x1) + 1, abs(y2 - y1) + 1);
+  if (blend) m_surface->setDrawingFlags(DSDRAW_NOFX);
+}
+
+void Renderer::upload(Image *image)
+{
+  DFBSurfaceDescription &dsc = image->dsc;
+  DFBSurfaceDescription video = dsc;
+  void *data;
+  int pitch;
+
+  if (!dsc.preallocated[0].data) return;
+
+  video.flags = (DFBSurfaceDescriptionFlags)(dsc.flags & ~DSDESC_PREALLOCATED);
+  video.caps = DSCAPS_VIDEOONLY;
+  if ((image->surface = createSurface(&video))) {
+    if (image->surface->lock(&data, &pitch)) {
+      for (int y=0; y < dsc.height; y++)
+	memcpy((char *)data + y * pitch, (char *)dsc.preallocated[0].data + y * dsc.preallocated[0].pitch, dsc.width * 4);
+      image->surface->unlock();
+    }
+    image->video = true;
+    m_residency.add(image, dsc.width * dsc.height * 4);
+  }
+  else {
+    debug("CreateSurface failed, using system memory copy\n");
+    dsc.caps = DSCAPS_NONE;
+    image->surface = createSurface(&dsc);
+    image->video = false;
+  }
+}
+
+void Renderer::updateCache(Image *image)
+{
+  // eviction may release surfaces that still have blits queued
+  if (m_surface) m_surface->flush();
+  m_image_cache.update(image);
+}
+
+void Renderer::load(Image *image, const char *prescaled)
+{
+  if (prescaled ? 
+      m_disk_cache.decodeImage(m_backend, prescaled, 1.0, 1.0, &image->dsc, &image->mapped) :
+      m_disk_cache.decodeImage(m_backend, image->path.c_str(), image->scale, m_scale, &image->dsc, &image->mapped))
+    upload(image);
+  image->loaded = true;
+  updateCache(image);
 }
 
 Image *Renderer::loadImage(const char *path, float scaleFactor, const char *prescaled)
 {
   if (!path || !path[0]) return NULL;
 
-  unsigned key = hash(path) + (unsigned)(100*scaleFactor);
-
-  if (m_image_cache.find(key) == m_image_cache.end()) {
-    Image *image = new Image;
-    image->surface = NULL;
-    image->dsc.preallocated[0].data = NULL;
-    
-    IDirectFBImageProvider *provider = NULL;
-    DFBSurfaceDescription &dsc = image->dsc;
-    if (prescaled) path = prescaled;
-    if (m_dfb->CreateImageProvider(m_dfb, path, &provider) == DFB_OK) {
-      if (provider->GetSurfaceDescription(provider, &dsc) == DFB_OK) {
-        if (!prescaled) {
-          dsc.width = (int)(dsc.width * scaleFactor * m_scale);
-          dsc.height = (int)(dsc.height * scaleFactor * m_scale);
-        }
-        dsc.flags = (DFBSurfaceDescriptionFlags)(dsc.flags | DSDESC_CAPS);
-        dsc.caps = (DFBSurfaceCapabilities)(DSCAPS_VIDEOONLY);
-	if ((image->surface = createSurface(&dsc))) {
-	  void *data;
-	  int pitch;
-	  provider->RenderTo(provider, image->surface, NULL);
-	  dsc.flags = (DFBSurfaceDescriptionFlags)(dsc.flags | DSDESC_PREALLOCATED);
-	  image->surface->Lock(image->surface, DSLF_READ, &data, &pitch);
- 	  if ((dsc.preallocated[0].data = malloc(pitch * dsc.height))) {
-	    memcpy(dsc.preallocated[0].data, data, pitch * dsc.height);
-	    dsc.preallocated[0].pitch = pitch;
-	    dsc.preallocated[1].data = NULL;
-	    dsc.preallocated[1].pitch = 0;
-	  }
-	  image->surface->Unlock(image->surface);
-	}
-	else {
-	  debug("CreateSurface failed\n");
-	}
-      }
-      else {
-	debug("GetSurfaceDescription failed\n");
-      }
-      provider->Release(provider);
+  Image *image = m_image_cache.get(path, scaleFactor);
+
+  if (!image->loaded) load(image, prescaled);
+  return image;
+}
+
+void Renderer::draw(Image *image, int x, int y, bool blend)
+{
+  scale(&x);
+  scale(&y);
+
+  if (!image->surface && image->dsc.preallocated[0].data) {
+    upload(image);
+    updateCache(image);
+  }
+  if (image->surface) {
+    m_residency.touch(image);
+    if (blend) m_surface->setBlittingFlags(DSBLIT_BLEND_ALPHACHANNEL);
+    m_surface->blit(image->surface, NULL, x, y);
+    if (blend) m_surface->setBlittingFlags(DSBLIT_NOFX);
+    damage(x, y, image->dsc.width, image->dsc.height);
+  }
+}
+
+ImageHandle Renderer::imageHandle(const char *path, float scaleFactor)
+{
+  if (!path || !path[0]) return NULL;
+  return m_image_cache.hold(path, scaleFactor);
+}
+
+void Renderer::image(int x, int y, const char *path, bool blend, float scaleFactor) 
+{
+  if (!path || !path[0]) return;
+  image(x, y, m_image_cache.get(path, scaleFactor), blend);
+}
+
+void Renderer::image(int x, int y, ImageHandle image, bool blend)
+{
+  if (!image) return;
+
+  m_image_cache.touch(image);
+  if (!image->loaded) load(image);
+  draw(image, x, y, blend);
+}
+
+void Renderer::imageAsync(int x, int y, const char *path, const char *placeholder, bool blend, float scaleFactor)
+{
+  if (!path || !path[0]) return;
+
+  Image *image = m_image_cache.get(path, scaleFactor);
+  PendingImage pending;
+
+  if (image->loaded || !m_image_loader) {
+    if (!image->loaded) image = loadImage(path, scaleFactor);
+    draw(image, x, y, blend);
+    return;
+  }
+
+  if (!image->pending) {
+    image->pending = true;
+    m_image_loader->request(image, path, scaleFactor, m_scale);
+  }
+
+  pending.image = image;
+  pending.box = Box(x, y, 0, 0);
+  if (placeholder && (image = loadImage(placeholder))) {
+    draw(image, x, y, blend);
+    pending.box.resize((int)(image->dsc.width / m_scale), (int)(image->dsc.height / m_scale));
+  }
+  for (int i=0; i < m_pending_images.size(); i++) {
+    if (m_pending_images[i].image == pending.image && 
+        m_pending_images[i].box.x == x && m_pending_images[i].box.y == y) return;
+  }
+  m_pending_images.push_back(pending);
+}
+
+bool Renderer::pollImages(std::vector<Box> &regions)
+{
+  ImageRequest request;
+
+  if (!m_image_loader) return false;
+
+  while (m_image_loader->finished(&request)) {
+    Image *image = request.image;
+    image->pending = false;
+    if (image->loaded || request.dropped) {
+      // loaded synchronously in the meantime, or dropped; repainting its
+      // placeholder requests it again if it is still on screen
+      if (request.ok) DiskCache::release(request.dsc.preallocated[0].data, request.mapped);
     }
     else {
-      debug("CreateImageProvider failed\n");
+      if (request.ok) {
+        image->dsc = request.dsc;
+        image->mapped = request.mapped;
+        upload(image);
+      }
+      image->loaded = true;
+      updateCache(image);
+    }
+    for (int i=0; i < m_pending_images.size(); ) {
+      if (m_pending_images[i].image == image) {
+        Box box = m_pending_images[i].box;
+        if (request.ok)
+          box = box + Box(box.x, box.y, (int)(image->dsc.width / m_scale), (int)(image->dsc.height / m_scale));
+        if (box.w > 0) regions.push_back(box);
+        m_pending_images.erase(m_pending_images.begin() + i);
+      }
+      else i++;
     }
-    m_image_cache[key] = image;
   }
-  return m_image_cache[key];
+  return !regions.empty();
 }
 
-void Renderer::image(int x, int y, const char *path, bool blend, float scaleFactor) 
+void Renderer::damage(int x, int y, int w, int h)
 {
-  fflush(stdout);
+  DFBRegion clip;
+  Box box(x, y, w, h);
 
-  scale(&x);
-  scale(&y);
+  m_surface->getClip(&clip);
+  box.clip(Box(clip.x1, clip.y1, clip.x2 - clip.x1 + 1, clip.y2 - clip.y1 + 1));
+  if (box.w > 0 && box.h > 0) m_damage.add(box);
+}
+
+void Renderer::flip(bool copy)
+{
+  int width, height;
 
-  Image *image = loadImage(path, scaleFactor);
+  if (m_damage.empty()) return;
 
-  if (image) {
-    if (!image->surface && image->dsc.preallocated[0].data) {
-      image->dsc.caps = DSCAPS_NONE;
-      m_dfb->CreateSurface(m_dfb, &image->dsc, &image->surface);
+  m_surface->getSize(&width, &height);
+  if (copy) {
+    // Leave the frame in the back buffer as well, so that the next frame
+    // only has to paint what changes.
+    m_surface->flip(NULL, (DFBSurfaceFlipFlags)(DSFLIP_WAITFORSYNC | DSFLIP_BLIT));
+  }
+  else if (m_damage.area() * 100 > width * height * FLIP_COPY_MAX_PERCENT) {
+    m_surface->flip(NULL, DSFLIP_WAITFORSYNC);
+    m_curr_buffer = !m_curr_buffer;
+  }
+  else {
+    // Copying leaves the back buffer holding the frame just presented,
+    // so it stays the active buffer.
+    for (int i=0; i < m_damage.size(); i++) {
+      const Box &b = m_damage.box(i);
+      DFBRegion region = { b.x, b.y, b.x + b.w - 1, b.y + b.h - 1 };
+      m_surface->flip(&region, (DFBSurfaceFlipFlags)(i ? DSFLIP_BLIT : DSFLIP_WAITFORSYNC | DSFLIP_BLIT));
     }
-    if (image->surface) {
-      if (blend) m_surface->SetBlittingFlags(m_surface, DSBLIT_BLEND_ALPHACHANNEL);
-      m_surface->Blit(m_surface, image->surface, NULL, x, y);
-      if (blend) m_surface->SetBlittingFlags(m_surface, DSBLIT_NOFX);
+  }
+  m_surface->endFrame();
+  m_damage.clear();
+}
+
+// Deletes the snapshots evicted so far.  Their screens find out from
+// present().
+void Renderer::dropSnapshots()
+{
+  std::list<Snapshot *>::iterator i = m_snapshots.begin();
+
+  while (i != m_snapshots.end()) {
+    if ((*i)->surface) {
+      i++;
+      continue;
     }
+    delete *i;
+    i = m_snapshots.erase(i);
+  }
+}
+
+// Copies the frame in the back buffer, evicting the oldest snapshots to
+// keep at most RENDERER_SNAPSHOTS.  Returns the id of the snapshot, or 0
+// if there is no room.
+int Renderer::snapshot()
+{
+  int width, height, bytes;
+  Surface *surface;
+
+  m_surface->getSize(&width, &height);
+  bytes = width * height * DFB_BYTES_PER_PIXEL(m_surface->pixelFormat());
+  // the copy needs the frame drawn, and eviction frees surfaces at once
+  m_surface->flush();
+  for (std::list<Snapshot *>::iterator i = m_snapshots.begin(); 
+       i != m_snapshots.end() && m_residency.stats().bytes[RESIDENT_SNAPSHOT] + bytes > RENDERER_SNAPSHOTS * bytes; i++)
+    m_residency.evict(*i);
+  dropSnapshots();
+  if (!(surface = createSurface(width, height, m_surface->pixelFormat())))
+    return 0;
+
+  surface->blit(m_backend->primary(), NULL, 0, 0);
+
+  Snapshot *snapshot = new Snapshot(++m_snapshot_id);
+  snapshot->surface = surface;
+  m_residency.add(snapshot, bytes);
+  m_snapshots.push_back(snapshot);
+  return snapshot->id;
+}
+
+// Shows snapshot in both buffers with one blit.  Returns false if it has
+// been evicted since.
+bool Renderer::present(int id)
+{
+  Snapshot *snapshot = NULL;
+  DFBRegion clip;
+  int width, height;
+
+  for (std::list<Snapshot *>::const_iterator i=m_snapshots.begin(); i != m_snapshots.end(); i++) {
+    if ((*i)->id == id) snapshot = *i;
   }
+  if (!snapshot || !snapshot->surface) return false;
+
+  m_surface->getSize(&width, &height);
+  m_surface->getClip(&clip);
+  m_surface->setClip(NULL);
+  m_surface->blit(snapshot->surface, NULL, 0, 0);
+  damage(0, 0, width, height);
+  m_surface->setClip(&clip);
+  flip(true);
+  return true;
 }
 
-void Renderer::flip()
+void Renderer::release(int id)
 {
-  m_surface->Flip(m_surface, NULL, DSFLIP_WAITFORSYNC);
-  m_curr_buffer = !m_curr_buffer;
+  for (std::list<Snapshot *>::iterator i=m_snapshots.begin(); i != m_snapshots.end(); i++) {
+    Snapshot *snapshot = *i;
+    if (snapshot->id != id) continue;
+    m_surface->flush();
+    m_residency.remove(snapshot);
+    m_snapshots.erase(i);
+    delete snapshot->surface;
+    delete snapshot;
+    return;
+  }
 }
 
-void Renderer::play(const char *file)
+// Re-uploads a working set recorded by Residency::suspend(), most
+// recently drawn first, until it no longer fits.
+void Renderer::restore(const std::vector<Resident *> &working_set)
 {
-  if (!file || !file[0]) return;
+  const ResidencyStats &stats = m_residency.stats();
+  int evictions = stats.evictions;
+
+  for (int i=0; i < working_set.size() && stats.evictions == evictions; i++) {
+    Resident *resident = working_set[i];
+    switch (resident->kind) {
+    case RESIDENT_IMAGE: {
+      Image *image = (Image *)resident;
+      if (!image->surface && image->dsc.preallocated[0].data) upload(image);
+      break;
+    }
+    case RESIDENT_GLYPHS:
+      ((AtlasPage *)resident)->upload(this);
+      break;
+    case RESIDENT_LABEL:
+      m_label_cache.restore((Label *)resident);
+      break;
+    default:
+      // snapshots are not worth the upload; screens repaint instead
+      break;
+    }
+  }
+}
+
+// Hands the display to the external player and returns the time it
+// exited, once the surfaces that were in use are back in video memory.
+unsigned Renderer::play(const char *file)
+{
+  if (!file || !file[0]) return m_scheduler.now();
 
+  std::vector<Resident *> working_set;
+  unsigned exited;
+#ifdef DEBUG
+  unsigned start;
+#endif
   int status;
   pid_t pid;
 
+  m_residency.suspend(working_set);
   destroy();
   if ((pid = fork()) == -1)
     perror("couldn't fork");
   else if (pid == 0)
+  {
     execl("/bin/mono", "/bin/mono", "-single", "-nogui", "-dram", "1", file, NULL);
+    _exit(1);
+  }
   else if ((pid = wait(&status)) == -1)
     perror("wait error");
+
+  exited = m_scheduler.now();
   init();
+#ifdef DEBUG
+  start = m_scheduler.now();
+#endif
+  restore(working_set);
+  debug("reinitialized in %u ms, restored %d surfaces in %u ms\n", start - exited, (int)working_set.size(), m_scheduler.now() - start);
+  return exited;
 }
 
-void Renderer::font(const char *path, int size)
+FontHandle Renderer::fontHandle(const char *path, int size)
 {
-  if (!path || !path[0]) return;
+  if (!path || !path[0]) return NULL;
 
   unsigned key = hash(path) + size;
+  font_map::iterator i = m_font_cache.find(key);
 
-  scale(&size);
+  if (i != m_font_cache.end()) return i->second;
 
-  if (m_font_cache.find(key) == m_font_cache.end()) {
-    m_font = new Font(this, path, size);
-    if (!m_font->isValid()) { 
-      fprintf(stderr, "FreeType: Could not find or load font file.\n");
-      delete m_font;
-      m_font = NULL;
-    }
-    m_font_cache[key] = m_font;
+  scale(&size);
+  Font *font = new Font(this, path, size);
+  if (!font->isValid()) { 
+    fprintf(stderr, "FreeType: Could not find or load font file.\n");
+    delete font;
+    font = NULL;
   }
-  m_font = m_font_cache[key];
+  m_font_cache[key] = font;
+  return font;
+}
+
+void Renderer::font(const char *path, int size)
+{
+  if (!path || !path[0]) return;
+  m_font = fontHandle(path, size);
 }
 
 int Renderer::textWidth(const char *str)
@@ -773,5 +631,80 @@ void Renderer::text( int x, int y, const char *text, int max_width, FontJustify
   scale(&y);
   scale(&max_width);
   
-  m_font->draw(x, y, text, max_width, justify, hardclip);
+  DFBRegion extent;
+  m_font->draw(x, y, text, max_width, justify, hardclip, &extent);
+  damage(extent.x1, extent.y1, extent.x2 - extent.x1 + 1, extent.y2 - extent.y1 + 1);
+}
+
+// Shapes str with the current font for repeated drawing with text().
+bool Renderer::layout(const char *str, int max_width, TextLayout *layout)
+{
+  if (!m_font) return false;
+
+  scale(&max_width);
+  *layout = m_font->layout(str, max_width);
+  return true;
+}
+
+void Renderer::text(int x, int y, const TextLayout &layout, FontJustify justify)
+{
+  if (!layout.font) return;
+
+  scale(&x);
+  scale(&y);
+
+  DFBRegion extent;
+  layout.font->draw(x, y, layout, justify, &extent);
+  damage(extent.x1, extent.y1, extent.x2 - extent.x1 + 1, extent.y2 - extent.y1 + 1);
+}
+
+void Renderer::label(int x, int y, const char *str, int max_width, FontJustify justify)
+{
+  if (!m_font || !str || !str[0]) return;
+
+  scale(&x);
+  scale(&y);
+  scale(&max_width);
+
+  Label *label = m_label_cache.get(m_font, str, max_width);
+  if (!label->surface) return;
+
+  switch (justify) {
+  case JUSTIFY_LEFT: break;
+  case JUSTIFY_RIGHT: x -= label->width; break;
+  case JUSTIFY_CENTER: x -= label->width / 2; break;
+  }
+  y -= label->ascent;
+
+  m_surface->setBlittingFlags((DFBSurfaceBlittingFlags)(DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE));
+  m_surface->blit(label->surface, NULL, x, y);
+  m_surface->setBlittingFlags(DSBLIT_NOFX);
+  damage(x, y, label->width, label->height);
+}
+
+// Draws the whole of str scrolled left by offset within width, followed
+// by a second copy gap pixels after its end.
+void Renderer::marquee(int x, int y, const char *str, int width, int offset, int gap)
+{
+  if (!m_font || !str || !str[0]) return;
+
+  scale(&x);
+  scale(&y);
+  scale(&width);
+  scale(&offset);
+  scale(&gap);
+
+  Label *label = m_label_cache.get(m_font, str);
+  if (!label->surface) return;
+
+  y -= label->ascent;
+  m_surface->setBlittingFlags((DFBSurfaceBlittingFlags)(DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE));
+  for (int start = x - offset; start < x + width; start += label->width + gap) {
+    int x1 = maximum(x, start), x2 = minimum(x + width, start + label->width);
+    if (x2 <= x1) continue;
+    DFBRectangle rect = { x1 - start, 0, x2 - x1, label->height };
+    m_surface->blit(label->surface, &rect, x1, y);
+  }
+  m_surface->setBlittingFlags(DSBLIT_NOFX);
+  damage(x, y, width, label->height);
 }
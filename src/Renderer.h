@@ -22,31 +22,52 @@
 
 #include "config.h"
 #include <directfb.h>
+#include <list>
 #include <map>
+#include <vector>
 #include "Box.h"
 #include "Event.h"
+#include "Backend.h"
+#include "BatchSurface.h"
 #include "ImageLoader.h"
-
-#define IMAGE_CACHE_SIZE 100
-#ifdef NMT
-#define INPUT_DEVICE DIDID_REMOTE
-#else
-#define INPUT_DEVICE DIDID_KEYBOARD
-#endif
+#include "ImageCache.h"
+#include "DiskCache.h"
+#include "Scheduler.h"
+#include "LabelCache.h"
+#include "Residency.h"
 
 #define FONT_NORMAL 0
 #define FONT_BOLD 1
+// How many screens covered by others keep a snapshot of their frame, in
+// video memory sized for the screen (8MB each at 1080p).
+#define RENDERER_SNAPSHOTS 2
 
 class Font;
 class NMTSettings;
+struct TextLayout;
 
-struct Image
+struct PendingImage
 {
-  DFBSurfaceDescription dsc;
-  IDirectFBSurface *surface;
+  Image *image;
+  Box box;
 };
 
-typedef std::map<unsigned, Image *> image_map;
+// A copy of a whole frame, dropped first when video memory runs short.
+// Screens keep the id, since the renderer deletes snapshots once evicted.
+struct Snapshot : public Resident
+{
+  int id;
+  Surface *surface;
+
+  Snapshot(int snapshot_id) : Resident(RESIDENT_SNAPSHOT), id(snapshot_id), surface(NULL) {}
+  virtual void evict() { delete surface; surface = NULL; }
+};
+
+// Resolved once and kept by callers, so painting skips the path lookup.
+// Both stay valid for the lifetime of the Renderer.
+typedef Font *FontHandle;
+typedef Image *ImageHandle;
+
 typedef std::map<unsigned, Font *> font_map;
 typedef enum { JUSTIFY_LEFT, JUSTIFY_RIGHT, JUSTIFY_CENTER } FontJustify;
 
@@ -55,53 +76,86 @@ class Renderer
  private:
   bool m_initialized;
   bool m_exit;
-  IDirectFB *m_dfb;
-  IDirectFBSurface *m_surface;
-  IDirectFBEventBuffer *m_eventBuffer;
-  IDirectFBInputDevice *m_input;
+  Backend *m_backend;
+  BatchSurface *m_surface;
   int m_curr_buffer;
   int m_width;
   int m_height;
   float m_scale;
   ImageLoader *m_image_loader;
-  image_map m_image_cache;
+  Residency m_residency;
+  ImageCache m_image_cache;
+  DiskCache m_disk_cache;
+  std::vector<PendingImage> m_pending_images;
+  Region m_damage;
+  LabelCache m_label_cache;
+  Clock m_clock;
+  Scheduler m_scheduler;
   font_map m_font_cache;
   Font *m_font;
-  int m_videoMode;
+  std::list<Snapshot *> m_snapshots;
+  int m_snapshot_id;
 
  private:
   void init();
   void destroy();
+  void dropSnapshots();
   void scale(int *x) { *x = (int)(*x * m_scale); }
   void unscale(int *x) { *x = (int)(*x / m_scale + 0.5); }
-  void setVideoMode(int videoMode);
+  void upload(Image *image);
+  void updateCache(Image *image);
+  void load(Image *image, const char *prescaled = NULL);
+  void damage(int x, int y, int w, int h);
+  void draw(Image *image, int x, int y, bool blend);
+  void restore(const std::vector<Resident *> &working_set);
 
  public:
   Renderer();
   ~Renderer();
-  void initialize(int argc, char **argv, NMTSettings * nmtSettings);
+  void initialize(int argc, char **argv, NMTSettings * nmtSettings, bool headless = false);
   bool initialized() { return m_initialized; }
-  IDirectFBSurface *surface() { return m_surface; }
-  IDirectFBSurface *createSurface(DFBSurfaceDescription *dsc);
-  IDirectFBSurface *createSurface(int width, int height, int pixelformat);
+  Backend *backend() { return m_backend; }
+  Surface *surface() { return m_surface; }
+  Surface *createSurface(DFBSurfaceDescription *dsc);
+  Surface *createSurface(int width, int height, int pixelformat);
   void exit() { m_exit = true; }
   int width() { return m_width; }
   int height() { return m_height; }
   float getScale() { return m_scale; }
+  ImageCache *imageCache() { return &m_image_cache; }
+  Residency *residency() { return &m_residency; }
+  DiskCache *diskCache() { return &m_disk_cache; }
+  Scheduler *scheduler() { return &m_scheduler; }
+  void setClock(Clock *clock) { m_scheduler.setClock(clock); }
   void loop(EventListener *listener);
   void color(unsigned char r, unsigned char g, unsigned char b, unsigned char alpha);
   int activeBuffer() { return m_curr_buffer; }
+  const FrameStats &frameStats() { return m_surface->frameStats(); }
+  int damageArea() { return m_damage.area(); }
   void setClip(Box *box);
   void getClip(Box *box);
   void rect(int x, int y, int w, int h);
   void line(int x1, int y1, int x2, int y2, bool blend = false);
   Image *loadImage(const char *path, float scaleFactor=1.0, const char *prescaled=NULL);
+  ImageHandle imageHandle(const char *path, float scaleFactor = 1.0);
   void image(int x, int y, const char *path, bool blend = false, float scaleFactor = 1.0);
+  void image(int x, int y, ImageHandle image, bool blend = false);
+  void imageAsync(int x, int y, const char *path, const char *placeholder = NULL, bool blend = false, float scaleFactor = 1.0);
+  bool pollImages(std::vector<Box> &regions);
+  FontHandle fontHandle(const char *path, int size = 32);
   void font(const char *path, int size = 32);
+  void font(FontHandle font) { m_font = font; }
   int textWidth(const char *str);
   void text(int x, int y, const char *str, int max_width = 0, FontJustify justify = JUSTIFY_LEFT, bool hardclip = false);
-  void flip();
-  void play(const char *file);
+  bool layout(const char *str, int max_width, TextLayout *layout);
+  void text(int x, int y, const TextLayout &layout, FontJustify justify = JUSTIFY_LEFT);
+  void label(int x, int y, const char *str, int max_width = 0, FontJustify justify = JUSTIFY_LEFT);
+  void marquee(int x, int y, const char *str, int width, int offset, int gap);
+  void flip(bool copy = false);
+  int snapshot();
+  bool present(int snapshot);
+  void release(int snapshot);
+  unsigned play(const char *file);
 };
 
 #endif
@@ -0,0 +1,78 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "Replay.h"
+
+static const struct { const char *name; Key key; } key_names[] = {
+  { "UP", KEY_UP }, { "DOWN", KEY_DOWN }, { "LEFT", KEY_LEFT }, { "RIGHT", KEY_RIGHT },
+  { "ENTER", KEY_ENTER }, { "BACK", KEY_BACK }, { "PAGE_UP", KEY_PAGE_UP }, { "PAGE_DOWN", KEY_PAGE_DOWN }
+};
+
+bool Replay::parseKey(const char *name, Key *key)
+{
+  if (!strncmp(name, "KEY_", 4)) name += 4;
+  // a single character types itself
+  if (name[0] > ' ' && name[0] <= '~' && !name[1]) {
+    *key = (Key)name[0];
+    return true;
+  }
+  for (int i=0; i < sizeof(key_names)/sizeof(key_names[0]); i++) {
+    if (!strcmp(name, key_names[i].name)) {
+      *key = key_names[i].key;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Replay::load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char buf[256], name[64];
+  int line = 0;
+
+  if (!f) {
+    fprintf(stderr, "Could not open replay script %s\n", path);
+    return false;
+  }
+
+  m_steps.clear();
+  while (fgets(buf, sizeof(buf), f)) {
+    ReplayStep step;
+    int fields;
+
+    line++;
+    if (buf[strspn(buf, " \t\r\n")] == '#' || !buf[strspn(buf, " \t\r\n")]) continue;
+
+    step.count = 1;
+    step.line = line;
+    fields = sscanf(buf, "%d %63s %d", &step.delay, name, &step.count);
+    if (fields < 2 || step.delay < 0 || step.count < 1 || !parseKey(name, &step.key)) {
+      fprintf(stderr, "%s:%d: expected <delay> <key> [<count>]\n", path, line);
+      fclose(f);
+      return false;
+    }
+    step.name = name;
+    m_steps.push_back(step);
+  }
+  fclose(f);
+  return true;
+}
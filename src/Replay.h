@@ -0,0 +1,63 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+#include "Event.h"
+
+// Time between the presses of a repeated key, as when it is held down.
+#define REPLAY_REPEAT_DELAY 100
+
+struct ReplayStep
+{
+  int delay;
+  Key key;
+  int count;
+  int line;
+  std::string name;
+};
+
+// A script of key presses, one step per line:
+//
+//   <delay in ms> <key> [<count>]
+//
+// where key is one of UP, DOWN, LEFT, RIGHT, ENTER, BACK, PAGE_UP and
+// PAGE_DOWN, optionally prefixed with KEY_, or a single character to
+// type it.  A count above one repeats
+// the key every REPLAY_REPEAT_DELAY ms.  Lines starting with # are
+// comments.
+
+class Replay
+{
+ private:
+  std::vector<ReplayStep> m_steps;
+
+ private:
+  static bool parseKey(const char *name, Key *key);
+
+ public:
+  bool load(const char *path);
+  int size() { return m_steps.size(); }
+  const ReplayStep &step(int i) { return m_steps[i]; }
+};
+
+#endif
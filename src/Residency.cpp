@@ -0,0 +1,104 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "config.h"
+#include "Residency.h"
+#include "Utils.h"
+
+Residency::Residency(int budget)
+  : m_target(NULL),
+    m_budget(budget)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+Residency::~Residency()
+{
+  report();
+}
+
+void Residency::add(Resident *resident, int bytes)
+{
+  remove(resident);
+  if (resident->evicted) m_stats.restores++;
+  resident->resident = true;
+  resident->evicted = false;
+  resident->video_bytes = bytes;
+  m_lru.push_front(resident);
+  resident->lru = m_lru.begin();
+  m_stats.bytes[resident->kind] += bytes;
+  m_stats.total += bytes;
+
+  while (m_stats.total > m_budget && evictOne(resident));
+  m_stats.peak = maximum(m_stats.peak, m_stats.total);
+}
+
+void Residency::remove(Resident *resident)
+{
+  if (!resident->resident) return;
+  m_lru.erase(resident->lru);
+  m_stats.bytes[resident->kind] -= resident->video_bytes;
+  m_stats.total -= resident->video_bytes;
+  resident->video_bytes = 0;
+  resident->resident = false;
+}
+
+bool Residency::evictOne(Resident *keep)
+{
+  if (m_lru.empty() || m_lru.back() == keep) return false;
+  evict(m_lru.back());
+  return true;
+}
+
+void Residency::evict(Resident *resident)
+{
+  if (!resident->resident) return;
+  // queued blits may still reference the surface
+  if (m_target) m_target->flush();
+  remove(resident);
+  resident->evicted = true;
+  m_stats.evictions++;
+  resident->evict();
+}
+
+// Evicts least recently drawn surfaces until at least bytes were freed.
+// Returns false if nothing could be evicted.
+bool Residency::reclaim(int bytes, Resident *keep)
+{
+  int total = m_stats.total;
+
+  while (total - m_stats.total < bytes && evictOne(keep));
+  return m_stats.total < total;
+}
+
+// Evicts everything, recording what was resident most recently drawn
+// first, so that it can be restored once the backend is open again.
+void Residency::suspend(std::vector<Resident *> &working_set)
+{
+  working_set.assign(m_lru.begin(), m_lru.end());
+  while (evictOne(NULL));
+}
+
+void Residency::report()
+{
+  debug("residency: %dk video (images %dk, glyphs %dk, labels %dk, snapshots %dk), peak %dk, %d evictions, %d restores, %d failures\n",
+        m_stats.total / 1024, m_stats.bytes[RESIDENT_IMAGE] / 1024, m_stats.bytes[RESIDENT_GLYPHS] / 1024,
+        m_stats.bytes[RESIDENT_LABEL] / 1024, m_stats.bytes[RESIDENT_SNAPSHOT] / 1024, m_stats.peak / 1024, m_stats.evictions, m_stats.restores, m_stats.failures);
+}
@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <list>
+#include <vector>
+#include "BatchSurface.h"
+
+#define RESIDENCY_VIDEO_BUDGET (24*1024*1024)
+
+typedef enum { RESIDENT_IMAGE, RESIDENT_GLYPHS, RESIDENT_LABEL, RESIDENT_SNAPSHOT, RESIDENT_KINDS } ResidentKind;
+
+// Something holding a video memory surface that it can rebuild on demand,
+// from a system memory copy or by rendering it again.  evict() drops the
+// surface, after which the resident is no longer tracked.
+
+class Resident
+{
+ public:
+  ResidentKind kind;
+  bool resident;
+  bool evicted;
+  int video_bytes;
+  std::list<Resident *>::iterator lru;
+
+  Resident(ResidentKind k) : kind(k), resident(false), evicted(false), video_bytes(0) {}
+  virtual ~Resident() {}
+  virtual void evict() = 0;
+};
+
+struct ResidencyStats
+{
+  int bytes[RESIDENT_KINDS];
+  int total;
+  int peak;
+  int evictions;
+  int restores;
+  int failures;
+};
+
+// Tracks video memory use of images, glyph pages, labels and screen
+// snapshots together.
+// Least recently drawn surfaces are evicted once the budget is exceeded,
+// or when creating a surface fails.
+
+class Residency
+{
+ private:
+  std::list<Resident *> m_lru;
+  BatchSurface *m_target;
+  int m_budget;
+  ResidencyStats m_stats;
+
+ private:
+  bool evictOne(Resident *keep);
+
+ public:
+  Residency(int budget=RESIDENCY_VIDEO_BUDGET);
+  ~Residency();
+  void setTarget(BatchSurface *target) { m_target = target; }
+  void add(Resident *resident, int bytes);
+  void remove(Resident *resident);
+  void touch(Resident *resident) { if (resident->resident) m_lru.splice(m_lru.begin(), m_lru, resident->lru); }
+  void evict(Resident *resident);
+  bool reclaim(int bytes, Resident *keep=NULL);
+  void suspend(std::vector<Resident *> &working_set);
+  void failed() { m_stats.failures++; }
+  const ResidencyStats &stats() { return m_stats; }
+  void report();
+};
+
+#endif
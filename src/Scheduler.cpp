@@ -0,0 +1,162 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <time.h>
+#include "Scheduler.h"
+
+// Monotonic, so timers keep running when the wall clock is set back.
+unsigned Clock::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+Scheduler::Scheduler(Clock *clock)
+  : m_clock(clock),
+    m_slot(0),
+    m_next_id(1)
+{
+  m_time = m_clock->now();
+}
+
+Scheduler::~Scheduler()
+{
+}
+
+// Only valid before any timer is scheduled, as deadlines are not carried
+// over to the new clock.
+void Scheduler::setClock(Clock *clock)
+{
+  m_clock = clock;
+  m_time = m_clock->now();
+}
+
+void Scheduler::insert(Timer &timer)
+{
+  // Round up so that a timer never fires before its deadline.
+  int ticks = ((int)(timer.deadline - m_time) + SCHEDULER_TICK - 1) / SCHEDULER_TICK;
+  if (ticks < 1) ticks = 1;
+  timer.rounds = (ticks - 1) / SCHEDULER_SLOTS;
+  std::list<Timer> &slot = m_slots[(m_slot + ticks) % SCHEDULER_SLOTS];
+  slot.push_back(timer);
+  m_timers[timer.id] = &slot.back();
+}
+
+int Scheduler::schedule(EventListener *listener, int delay, int period)
+{
+  Timer timer;
+
+  timer.id = m_next_id++;
+  if (m_next_id < 0) m_next_id = 1;
+  timer.listener = listener;
+  timer.deadline = m_clock->now() + delay;
+  timer.period = period;
+  insert(timer);
+  return timer.id;
+}
+
+void Scheduler::cancel(int id)
+{
+  std::map<int, Timer *>::iterator it = m_timers.find(id);
+  if (it == m_timers.end()) return;
+  it->second->listener = NULL;
+  m_timers.erase(it);
+}
+
+void Scheduler::cancel(EventListener *listener)
+{
+  std::map<int, Timer *>::iterator it = m_timers.begin();
+  while (it != m_timers.end()) {
+    if (it->second->listener == listener) {
+      it->second->listener = NULL;
+      m_timers.erase(it++);
+    }
+    else it++;
+  }
+}
+
+int Scheduler::timeout()
+{
+  int ticks = -1, left;
+
+  if (m_timers.empty()) return -1;
+
+  // A timer due in this revolution beats anything in later slots or
+  // rounds, so the scan stops at the first one.
+  for (int i=1; i <= SCHEDULER_SLOTS; i++) {
+    std::list<Timer> &slot = m_slots[(m_slot + i) % SCHEDULER_SLOTS];
+    bool due = false;
+    for (std::list<Timer>::iterator it = slot.begin(); it != slot.end(); it++) {
+      if (!it->listener) continue;
+      int t = i + it->rounds * SCHEDULER_SLOTS;
+      if (ticks < 0 || t < ticks) ticks = t;
+      if (!it->rounds) due = true;
+    }
+    if (due) break;
+  }
+  if (ticks < 0) return -1;
+
+  left = (int)(m_time + ticks * SCHEDULER_TICK - m_clock->now());
+  return left < 0 ? 0 : left;
+}
+
+bool Scheduler::run()
+{
+  unsigned now = m_clock->now();
+  bool fired = false;
+
+  while ((int)(now - m_time) >= SCHEDULER_TICK) {
+    m_time += SCHEDULER_TICK;
+    m_slot = (m_slot + 1) % SCHEDULER_SLOTS;
+    std::list<Timer> &slot = m_slots[m_slot];
+    std::list<Timer>::iterator it = slot.begin();
+    while (it != slot.end()) {
+      if (it->listener && it->rounds > 0) {
+        it->rounds--;
+        it++;
+        continue;
+      }
+      if (it->listener) {
+        m_firing.push_back(*it);
+        m_timers[it->id] = &m_firing.back();
+      }
+      it = slot.erase(it);
+    }
+  }
+
+  while (!m_firing.empty()) {
+    Timer timer = m_firing.front();
+    m_firing.pop_front();
+    // Skip timers cancelled by an earlier handler.
+    if (!timer.listener) continue;
+    m_timers.erase(timer.id);
+    // Periodic timers keep their id and are re-armed before the handler
+    // runs, so that it can cancel them.
+    if (timer.period > 0) {
+      timer.deadline += timer.period;
+      if ((int)(timer.deadline - now) <= 0) timer.deadline = now + timer.period;
+      insert(timer);
+    }
+    timer.listener->handleTimer(timer.id);
+    fired = true;
+  }
+
+  return fired;
+}
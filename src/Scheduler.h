@@ -0,0 +1,92 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <list>
+#include <map>
+#include "Event.h"
+
+#define SCHEDULER_TICK 10
+#define SCHEDULER_SLOTS 256
+
+class Clock
+{
+ public:
+  virtual ~Clock() {};
+  // Milliseconds from an arbitrary origin; wraps around.
+  virtual unsigned now();
+};
+
+// Time only moves when advanced, for repeatable runs.
+class ManualClock : public Clock
+{
+ private:
+  unsigned m_now;
+
+ public:
+  ManualClock() : m_now(0) {}
+  virtual unsigned now() { return m_now; }
+  void advance(int ms) { m_now += ms; }
+};
+
+struct Timer
+{
+  int id;
+  EventListener *listener;
+  unsigned deadline;
+  int period;
+  int rounds;
+};
+
+// Hashed timer wheel.  Each slot covers SCHEDULER_TICK ms; timers further
+// out than one revolution wait there for the remaining number of rounds.
+// Cancelled timers are detached from their listener and dropped when
+// their slot comes around, so handlers may cancel or delete freely.
+
+class Scheduler
+{
+ private:
+  Clock *m_clock;
+  std::list<Timer> m_slots[SCHEDULER_SLOTS];
+  std::list<Timer> m_firing;
+  std::map<int, Timer *> m_timers;
+  int m_slot;
+  unsigned m_time;
+  int m_next_id;
+
+ private:
+  void insert(Timer &timer);
+
+ public:
+  Scheduler(Clock *clock);
+  ~Scheduler();
+  Clock *clock() { return m_clock; }
+  void setClock(Clock *clock);
+  unsigned now() { return m_clock->now(); }
+  int schedule(EventListener *listener, int delay, int period = 0);
+  void cancel(int id);
+  void cancel(EventListener *listener);
+  bool pending(int id) { return m_timers.find(id) != m_timers.end(); }
+  int timeout();
+  bool run();
+};
+
+#endif
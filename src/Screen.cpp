@@ -25,4 +25,16 @@ Screen::Screen(Application *application)
 {
   m_app = application;
   resize(m_app->renderer()->width(), m_app->renderer()->height());
+  m_snapshot = 0;
+}
+
+Screen::~Screen()
+{
+  setSnapshot(0);
+}
+
+void Screen::setSnapshot(int snapshot)
+{
+  if (m_snapshot) m_app->renderer()->release(m_snapshot);
+  m_snapshot = snapshot;
 }
@@ -26,8 +26,15 @@ class Application;
 
 class Screen : public Widget
 {
+ private:
+  int m_snapshot;
+
  public:
   Screen(Application *application);  
+  virtual ~Screen();
+  // The id of the last frame of this screen while another covers it.
+  int snapshot() { return m_snapshot; }
+  void setSnapshot(int snapshot);
 };
 
 class TestScreen : public Screen
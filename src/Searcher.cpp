@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Searcher.h"
+
+Searcher::Searcher(Backend *backend, const char *file)
+  : Thread(),
+    m_backend(backend),
+    m_file(file),
+    m_generation(0),
+    m_searching(0),
+    m_pending(false),
+    m_finished(false)
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_cond, NULL);
+}
+
+Searcher::~Searcher()
+{
+  stop();
+  pthread_cond_destroy(&m_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void Searcher::stop()
+{
+  if (!m_running) return;
+  pthread_mutex_lock(&m_mutex);
+  m_running = false;
+  m_generation++;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+  Thread::stop();
+}
+
+void Searcher::request(const char *terms)
+{
+  pthread_mutex_lock(&m_mutex);
+  m_generation++;
+  m_terms = terms;
+  m_pending = true;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void Searcher::cancel()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_generation++;
+  m_pending = false;
+  m_finished = false;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+bool Searcher::finished(std::string *terms, std::vector<SearchResult> *results)
+{
+  bool found = false;
+
+  pthread_mutex_lock(&m_mutex);
+  if (m_finished) {
+    *terms = m_done_terms;
+    results->swap(m_results);
+    m_finished = false;
+    found = true;
+  }
+  pthread_mutex_unlock(&m_mutex);
+  return found;
+}
+
+// Interrupts the search once it has been superseded.
+int Searcher::progress(void *arg)
+{
+  Searcher *searcher = (Searcher *)arg;
+  return searcher->m_generation != searcher->m_searching;
+}
+
+void Searcher::run()
+{
+  Database db(m_file.c_str());
+  std::vector<SearchResult> results;
+  std::string terms;
+  bool ok;
+
+  db.progress(progress, this);
+  pthread_mutex_lock(&m_mutex);
+  while (m_running) {
+    if (!m_pending) {
+      pthread_cond_wait(&m_cond, &m_mutex);
+      continue;
+    }
+    m_pending = false;
+    m_searching = m_generation;
+    terms = m_terms;
+    pthread_mutex_unlock(&m_mutex);
+
+    ok = db.search(terms.c_str(), SEARCH_LIMIT, results);
+
+    pthread_mutex_lock(&m_mutex);
+    if (ok && m_searching == m_generation) {
+      m_done_terms = terms;
+      m_results.swap(results);
+      m_finished = true;
+      m_backend->wakeUp();
+    }
+  }
+  pthread_mutex_unlock(&m_mutex);
+}
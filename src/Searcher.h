@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEARCHER_H
+#define SEARCHER_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Thread.h"
+#include "Backend.h"
+#include "Database.h"
+
+#define SEARCH_LIMIT 200
+
+// Runs searches on a connection of its own in the background.  Each
+// request or cancel() interrupts the search in progress, so only the
+// newest terms are ever searched to the end.
+
+class Searcher : public Thread
+{
+ private:
+  Backend *m_backend;
+  std::string m_file;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  volatile int m_generation;
+  int m_searching;
+  bool m_pending;
+  std::string m_terms;
+  bool m_finished;
+  std::string m_done_terms;
+  std::vector<SearchResult> m_results;
+
+ private:
+  static int progress(void *arg);
+
+ protected:
+  virtual void run();
+
+ public:
+  Searcher(Backend *backend, const char *file = DB_FILE);
+  virtual ~Searcher();
+  virtual void stop();
+  void request(const char *terms);
+  void cancel();
+  bool finished(std::string *terms, std::vector<SearchResult> *results);
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#include <directfb.h>
+
+// Drawing target used by the Renderer and Font.  Each Backend provides
+// its own implementation (DirectFB surfaces, plain memory buffers).
+
+class Surface
+{
+ public:
+  virtual ~Surface() {};
+  virtual void getSize(int *width, int *height) = 0;
+  virtual DFBSurfacePixelFormat pixelFormat() = 0;
+  virtual void setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char a) = 0;
+  virtual void setClip(const DFBRegion *clip) = 0;
+  virtual void getClip(DFBRegion *clip) = 0;
+  virtual void setDrawingFlags(DFBSurfaceDrawingFlags flags) = 0;
+  virtual void setBlittingFlags(DFBSurfaceBlittingFlags flags) = 0;
+  virtual void fillRectangle(int x, int y, int w, int h) = 0;
+  virtual void drawLine(int x1, int y1, int x2, int y2) = 0;
+  virtual void blit(Surface *source, const DFBRectangle *rect, int x, int y) = 0;
+  virtual void batchBlit(Surface *source, const DFBRectangle *rects, const DFBPoint *points, int num) = 0;
+  virtual void flip(const DFBRegion *region, DFBSurfaceFlipFlags flags) = 0;
+  virtual bool lock(void **data, int *pitch) = 0;
+  virtual void unlock() = 0;
+};
+
+#endif
@@ -28,9 +28,7 @@ TVShowsMenu::TVShowsMenu(Application *application, const char *title, const char
 
 void TVShowsMenu::selectFile(File &file)
 {
-  if (!m_app->audio()->isStopped()) m_app->audio()->close();
-  debug("playing %s\n", file.path());
-  m_app->renderer()->play(file.path());
+  m_app->play(file.path());
 }
 
 void TVShowsMenu::selectDirectory(File &file)
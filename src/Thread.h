@@ -36,7 +36,7 @@ class Thread
 
  public:
   Thread();
-  ~Thread();
+  virtual ~Thread();
   virtual void start();
   virtual void stop();
 };
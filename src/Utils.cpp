@@ -17,6 +17,12 @@
   along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "Utils.h"
 
 unsigned hash(const char *s)
@@ -26,3 +32,79 @@ unsigned hash(const char *s)
     h = h * 101 + (unsigned int)((unsigned char *) *s++);
   return h;
 }
+
+// Returns the length of the well-formed sequence at b, or 0.  Overlong
+// forms, surrogates and code points above U+10FFFF are rejected.
+static int decodeSequence(const unsigned char *b, const unsigned char *end, long *ucs)
+{
+  unsigned c = b[0], min;
+  int len;
+
+  if (c >= 0xc2 && c <= 0xdf) { len = 2; c &= 0x1f; min = 0x80; }
+  else if (c >= 0xe0 && c <= 0xef) { len = 3; c &= 0x0f; min = 0x800; }
+  else if (c >= 0xf0 && c <= 0xf4) { len = 4; c &= 0x07; min = 0x10000; }
+  else return 0;
+
+  if (end - b < len) return 0;
+  for (int i=1; i < len; i++) {
+    if ((b[i] & 0xc0) != 0x80) return 0;
+    c = (c << 6) | (b[i] & 0x3f);
+  }
+  if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) return 0;
+  *ucs = c;
+  return len;
+}
+
+// Decodes length bytes of UTF-8 into at most ucs_max code points and
+// returns how many were written.  Each byte that does not start a valid
+// sequence becomes UTF8_REPLACEMENT.  Runs of ASCII are checked a vector
+// (or machine word) at a time.
+int decodeUTF8(const char *bytes, int length, long *ucs, int ucs_max)
+{
+  const unsigned char *b = (const unsigned char *)bytes, *end = b + length;
+  int n = 0, len;
+
+  if (!bytes) return 0;
+
+  while (b < end && n < ucs_max) {
+    if (*b < 0x80) {
+#if defined(__SSE2__)
+      while (end - b >= 16 && ucs_max - n >= 16 &&
+             !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)b))) {
+        for (int i=0; i < 16; i++) ucs[n + i] = b[i];
+        b += 16;
+        n += 16;
+      }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+      while (end - b >= 16 && ucs_max - n >= 16) {
+        uint8x16_t v = vld1q_u8(b);
+        uint8x8_t high = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(high), 0) & 0x8080808080808080ULL) break;
+        for (int i=0; i < 16; i++) ucs[n + i] = b[i];
+        b += 16;
+        n += 16;
+      }
+#else
+      const unsigned long high = ~0UL / 0xff * 0x80;
+      unsigned long word;
+      while (end - b >= (int)sizeof(word) && ucs_max - n >= (int)sizeof(word)) {
+        memcpy(&word, b, sizeof(word));
+        if (word & high) break;
+        for (int i=0; i < (int)sizeof(word); i++) ucs[n + i] = b[i];
+        b += sizeof(word);
+        n += sizeof(word);
+      }
+#endif
+      while (b < end && *b < 0x80 && n < ucs_max) ucs[n++] = *b++;
+    }
+    else if ((len = decodeSequence(b, end, &ucs[n]))) {
+      b += len;
+      n++;
+    }
+    else {
+      ucs[n++] = UTF8_REPLACEMENT;
+      b++;
+    }
+  }
+  return n;
+}
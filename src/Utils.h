@@ -25,6 +25,9 @@
 
 #define safe_strcpy(dst, src) {strncpy(dst, (src) ? (src) : "", sizeof(dst)-1); (dst)[sizeof(dst)-1]=0;}
 
+#define UTF8_REPLACEMENT 0xfffd
+
 unsigned hash(const char *s);
+int decodeUTF8(const char *bytes, int length, long *ucs, int ucs_max);
 
 #endif
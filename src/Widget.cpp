@@ -35,6 +35,11 @@ Widget::Widget(Widget *parent)
   setDirty();
 }
 
+Widget::~Widget()
+{
+  if (m_app) m_app->renderer()->scheduler()->cancel(this);
+}
+
 bool Widget::handleEvent(Event &event)
 {
   return true;
@@ -61,7 +66,7 @@ void Widget::update_screen_xy()
   }
 }
 
-Box Widget::getDirtyRegion(int buffer)
+const Region &Widget::getDirtyRegion(int buffer)
 {
   if (buffer < 0) buffer = m_app ? m_app->renderer()->activeBuffer() : 0;
   return m_dirty[buffer];
@@ -70,13 +75,13 @@ Box Widget::getDirtyRegion(int buffer)
 bool Widget::dirty(int buffer)
 {
   if (buffer < 0) buffer = m_app ? m_app->renderer()->activeBuffer() : 0;
-  return m_dirty[buffer].w > 0;
+  return !m_dirty[buffer].empty();
 }
 
 void Widget::clearDirty(int buffer)
 {
   if (buffer < 0) buffer = m_app ? m_app->renderer()->activeBuffer() : 0;
-  m_dirty[buffer] = Box(0,0,0,0);  
+  m_dirty[buffer].clear();
 }
 
 void Widget::setDirtyRegion(Box region, int buffer)
@@ -86,7 +91,7 @@ void Widget::setDirtyRegion(Box region, int buffer)
     setDirtyRegion(region, 1);
   }
   else 
-    m_dirty[buffer] = m_dirty[buffer] + region;
+    m_dirty[buffer].add(region);
 }
 
 void Widget::setDirty(int buffer)
@@ -95,8 +100,10 @@ void Widget::setDirty(int buffer)
     setDirty(0);
     setDirty(1);
   }
-  else
-    m_dirty[buffer] = Box(m_box.x, m_box.y, m_box.w, m_box.h);
+  else {
+    m_dirty[buffer].clear();
+    m_dirty[buffer].add(Box(m_box.x, m_box.y, m_box.w, m_box.h));
+  }
 }
 
 void Widget::move(int x, int y)
@@ -137,7 +144,7 @@ void Widget::paint()
   debug("in Widget::paint()\n");
   if (m_app) {
     Renderer *r = m_app->renderer();
-    Box dirty = getDirtyRegion();
+    Box dirty = getDirtyRegion().bounds();
     r->color(0,0,0,0xff);
     r->rect(m_screen_x, m_screen_y, dirty.w, dirty.h);
   }
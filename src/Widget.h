@@ -34,16 +34,16 @@ class Widget : public EventListener
   char m_label[MAX_LABEL_LENGTH];
   Widget *m_parent;
   class Application *m_app;
-  Box m_dirty[2];
+  Region m_dirty[2];
 
  private:
   void update_screen_xy();
   
  public:
   Widget(Widget *parent);
-  virtual ~Widget() {};
+  virtual ~Widget();
   class Application *application() { return m_app; }
-  Box getDirtyRegion(int buffer=-1);
+  const Region &getDirtyRegion(int buffer=-1);
   bool dirty(int buffer=-1);
   void setDirtyRegion(Box region, int buffer=-1);
   void setDirty(int buffer=-1);
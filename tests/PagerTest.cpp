@@ -0,0 +1,110 @@
+/*
+  Copyright (c) 2009 Vinay Pulim
+
+  This file is part of TankTV.
+
+  TankTV is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TankTV is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TankTV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Pages through keys that are NULL, empty or equal to each other and
+// checks every row comes back once, in order.  Run with make check.
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include "Pager.h"
+
+#define PAGE_SIZE 50
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  if (ok) return;
+  fprintf(stderr, "FAILED: %s\n", what);
+  failures++;
+}
+
+// Reads every page into rows, returning how many there were.
+static int readAll(Database *db, Pager &pager, std::vector<QueryRow> *rows)
+{
+  Query query(db, pager.first(PAGE_SIZE).c_str());
+  QueryResult page;
+  int pages = 1;
+
+  QueryLoader::load(query, &page);
+  pager.add(page, PAGE_SIZE);
+  rows->insert(rows->end(), page.rows.begin(), page.rows.end());
+  while (pager.next(db, PAGE_SIZE, &page)) {
+    rows->insert(rows->end(), page.rows.begin(), page.rows.end());
+    pages++;
+  }
+  return pages;
+}
+
+static void testSongs(Database *db)
+{
+  Pager pager("title", "songs.rowid", "songs.rowid", "songs", "1");
+  std::vector<QueryRow> rows;
+  std::set<std::string> seen;
+  bool ordered = true;
+
+  // more NULL titles than fit a page
+  for (int i=0; i < 60; i++) db->execute("insert into songs (title) values (NULL)");
+  for (int i=0; i < 30; i++) db->execute("insert into songs (title) values ('')");
+  for (int i=0; i < 40; i++) db->execute("insert into songs (title) values (%Q)", i % 2 ? "Same" : "same");
+  for (int i=0; i < 20; i++) db->execute("insert into songs (title) values ('song %02d')", i);
+
+  check(readAll(db, pager, &rows) == 3, "songs come in 3 pages");
+  check(rows.size() == 150, "every song is read");
+  for (int i=0; i < (int)rows.size(); i++) {
+    seen.insert(rows[i].text[1]);
+    if (i && strcasecmp(rows[i-1].text[0].c_str(), rows[i].text[0].c_str()) > 0) ordered = false;
+  }
+  check(seen.size() == rows.size(), "no song is read twice");
+  check(ordered, "songs are read in key order");
+  check(rows.size() == 150 && rows[89].text[0] == "" && rows[90].text[0] == "same", "NULL titles read as empty ones");
+}
+
+static void testGroups(Database *db)
+{
+  Pager pager("album", "album", "count(1) as tracks", "albums", "1", "ifnull(album, '')");
+  std::vector<QueryRow> rows;
+  Query index(db, pager.index().c_str());
+  int counted = 0;
+
+  db->execute("insert into albums (album) values (NULL)");
+  db->execute("insert into albums (album) values ('')");
+  for (int i=0; i < 60; i++) db->execute("insert into albums (album) values ('album %02d')", i);
+  for (int i=0; i < 60; i++) db->execute("insert into albums (album) values ('ALBUM %02d')", i);
+
+  // names differing in case are grouped apart but share a key
+  check(readAll(db, pager, &rows) == 3, "albums come in 3 pages");
+  check(rows.size() == 121, "every album is read once");
+  check(!rows.empty() && rows[0].text[0] == "" && rows[0].text[2] == "2", "albums without a name are listed once");
+  check(rows.size() == 121 && rows[120].text[0] == "album 59", "albums are read in key order");
+  while (index.step()) counted += index.integer(1);
+  check(counted == 121, "the index counts every album");
+}
+
+int main(int argc, char **argv)
+{
+  Database db(":memory:");
+
+  testSongs(&db);
+  testGroups(&db);
+  if (!failures) printf("pager: ok\n");
+  return failures ? 1 : 0;
+}